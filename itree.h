@@ -82,15 +82,19 @@ struct node *INT_TREE_BALANCE_##node##_##field(struct node *);
                                                                                                         \
 unsigned int BOOL_INT_INTERSECT_##node##_##field(struct node *, struct node *);                         \
                                                                                                         \
+void INT_SET_MAX_HIGH_##node##_##field(struct node *);                                                  \
+                                                                                                        \
 void INT_FIX_MAX_HIGH_##node##_##field(struct node *);                                                  \
                                                                                                         \
 unsigned long long INT_MAX_INTERSECT_##node##_##field(struct node *, struct node *);	                \
                                                                                                         \
-unsigned long long INT_ALL_INTERSECT_##node##_##field(struct node *, struct node *);	                \
+unsigned long long INT_ALL_INTERSECT_##node##_##field(struct node *, struct node *,                     \
+    void (*)(struct node *, unsigned long long, void *), void *);                                       \
                                                                                                         \
 unsigned long long INT_MAX_CONTAINMENT_##node##_##field(struct node *, struct node *);	                \
                                                                                                         \
-unsigned long long INT_ALL_CONTAINMENT_##node##_##field(struct node *, struct node *);	                \
+unsigned long long INT_ALL_CONTAINMENT_##node##_##field(struct node *, struct node *,                   \
+    void (*)(struct node *, unsigned long long, void *), void *);                                       \
                                                                                                         \
 struct node *TREE_BALANCE_##node##_##field(struct node *);		                                \
                                                                                                         \
@@ -212,21 +216,31 @@ void TREE_REVERSE_APPLY_ALL_##node##_##field
 struct node *INT_TREE_ROTL_##node##_##field(struct node *self)                                          \
   {                                                                                                     \
     struct node *r= self->field.avl_right;                                                              \
+    r->field.parent= self->field.parent;                                                                \
     self->field.avl_right= r->field.avl_left;                                                           \
-       INT_FIX_MAX_HIGH_##node##_##field(self);                                                         \
+    if (self->field.avl_right) {self->field.avl_right->field.parent= self;}                             \
+    r->field.avl_left= self;                                                                            \
+    self->field.parent= r;                                                                              \
+       INT_SET_MAX_HIGH_##node##_##field(self);                                                         \
                                                                                                         \
     r->field.avl_left= INT_TREE_BALANCE_##node##_##field(self);                                         \
-       INT_FIX_MAX_HIGH_##node##_##field(r);                                                            \
+    r->field.avl_left->field.parent= r;                                                                 \
+       INT_SET_MAX_HIGH_##node##_##field(r);                                                            \
     return INT_TREE_BALANCE_##node##_##field(r);                                                        \
   }                                                                                                     \
                                                                                                         \
 struct node *INT_TREE_ROTR_##node##_##field(struct node *self)                                          \
   {                                                                                                     \
     struct node *l= self->field.avl_left;                                                               \
+    l->field.parent= self->field.parent;                                                                \
     self->field.avl_left= l->field.avl_right;                                                           \
-       INT_FIX_MAX_HIGH_##node##_##field(self);                                                         \
+    if (self->field.avl_left) {self->field.avl_left->field.parent= self;}                               \
+    l->field.avl_right= self;                                                                           \
+    self->field.parent= l;                                                                              \
+       INT_SET_MAX_HIGH_##node##_##field(self);                                                         \
     l->field.avl_right= INT_TREE_BALANCE_##node##_##field(self);                                        \
-       INT_FIX_MAX_HIGH_##node##_##field(l);                                                            \
+    l->field.avl_right->field.parent= l;                                                                \
+       INT_SET_MAX_HIGH_##node##_##field(l);                                                            \
                                                                                                         \
     return INT_TREE_BALANCE_##node##_##field(l);                                                        \
   }                                                                                                     \
@@ -239,18 +253,18 @@ struct node *INT_TREE_BALANCE_##node##_##field(struct node *self)
       {								                                        \
 	if (TREE_DELTA(self->field.avl_right, field) > 0) {                                             \
 	  self->field.avl_right= INT_TREE_ROTR_##node##_##field(self->field.avl_right);                 \
-	    INT_FIX_MAX_HIGH_##node##_##field(self->field.avl_right);                                   \
+	    INT_SET_MAX_HIGH_##node##_##field(self->field.avl_right);                                   \
         }									                        \
-	    INT_FIX_MAX_HIGH_##node##_##field(self);                                                    \
+	    INT_SET_MAX_HIGH_##node##_##field(self);                                                    \
 	  return INT_TREE_ROTL_##node##_##field(self);				                        \
       }                                                                                                 \
     else if (delta > TREE_DELTA_MAX)						                        \
       {										                        \
 	if (TREE_DELTA(self->field.avl_left, field) < 0) {			                        \
 	  self->field.avl_left= INT_TREE_ROTL_##node##_##field(self->field.avl_left);                   \
-	    INT_FIX_MAX_HIGH_##node##_##field(self->field.avl_left);                                    \
+	    INT_SET_MAX_HIGH_##node##_##field(self->field.avl_left);                                    \
 	}                                                                                               \
-	INT_FIX_MAX_HIGH_##node##_##field(self);			                                \
+	INT_SET_MAX_HIGH_##node##_##field(self);			                                \
 	return INT_TREE_ROTR_##node##_##field(self);				                        \
       }										                        \
     self->field.avl_height= 0;							                        \
@@ -263,77 +277,47 @@ struct node *INT_TREE_BALANCE_##node##_##field(struct node *self)
     return self;										        \
   }                                                                                                     \
                                                                                                         \
+ /* recompute max_high for self alone from its own high and its children.  rotations and */             \
+ /* splices use this: they rearrange a subtree without changing the set of intervals in    */           \
+ /* it, and self's parent may not point at self yet, so nothing above self is touched      */           \
+                                                                                                        \
+void INT_SET_MAX_HIGH_##node##_##field(struct node *self)                                               \
+  {                                                                                                     \
+    if (!self) {                                                                                        \
+      return;                                                                                           \
+    }                                                                                                   \
+    self->max_high= self->high;                                                                         \
+    if (self->field.avl_left && (self->field.avl_left->max_high > self->max_high)) {                    \
+      self->max_high= self->field.avl_left->max_high;                                                   \
+    }                                                                                                   \
+    if (self->field.avl_right && (self->field.avl_right->max_high > self->max_high)) {                  \
+      self->max_high= self->field.avl_right->max_high;                                                  \
+    }                                                                                                   \
+  }                                                                                                     \
+                                                                                                        \
 void INT_FIX_MAX_HIGH_##node##_##field(struct node *self)                                               \
   {                                                                                                     \
                                                                                                         \
     long long int max_high=0;                                                                           \
-    long long int max_self_high=0;                                                                      \
-    long long int max_LC_high=0;                                                                        \
-    long long int max_RC_high=0;                                                                        \
                                                                                                         \
-    struct node *l;                                                                                     \
-    struct node *r;                                                                                     \
     struct node *p;                                                                                     \
-    struct node *t;                                                                                     \
-                                                                                                        \
-                                                                                                        \
-    if (self) {                                                                                         \
-                                                                                                        \
-    /* fixup max_high */                                                                                \
                                                                                                         \
                                                                                                         \
-    /*    printf("1\n"); */						\
-    max_self_high = self->high;                                                                         \
-    /*    printf("3\n"); */						\
-    if (self->field.avl_left) {                                                                         \
-       max_LC_high   = self->field.avl_left->max_high;				                        \
-    }                                                                                                   \
-    if (self->field.avl_right) {					                                \
-       max_RC_high   = self->field.avl_right->max_high;                                                 \
-    }									                                \
-    if (max_self_high > max_high) {max_high = max_self_high;}                                           \
-    if (max_LC_high   > max_high) {max_high = max_LC_high;}                                             \
-    if (max_RC_high   > max_high) {max_high = max_RC_high;}                                             \
-                                                                                                        \
-    /*    printf("2\n");	*/					\
-    /* fixup max_high for self and parents, if max_high needs to be raised */                           \
-                                                                                                        \
-    if (self->max_high < max_high) {                                                                    \
-      self->max_high = max_high;                                                                        \
-    }                                                                                                   \
-    if (self->field.parent) {                                                                           \
-       p=self->field.parent;                                                                            \
+    /* recompute max_high for self from its own high and its children, then for each parent */          \
+    /* in turn, stopping at the first parent whose max_high does not change                 */          \
                                                                                                         \
-       while (p && (p->max_high < max_high)) {                                                          \
-          p->max_high=max_high;                                                                         \
-          t=p->field.parent;                                                                            \
-          p=t;                                                                                          \
+    for (p= self; p; p= p->field.parent) {                                                              \
+       max_high = p->high;                                                                              \
+       if (p->field.avl_left && (p->field.avl_left->max_high > max_high)) {                             \
+          max_high = p->field.avl_left->max_high;                                                       \
        }                                                                                                \
-                                                                                                        \
-    /* fixup max_high for parents, if max_high needs to be lowered */                                   \
-                                                                                                        \
-       p=self->field.parent;                                                                            \
-                                                                                                        \
-       while (p && (p->max_high > max_high)) {                                                          \
-                                                                                                        \
-         max_high      = 0;                                                                             \
-         max_LC_high   = 0;                                                                             \
-         max_self_high = self->max_high;                                                                \
-                                                                                                        \
-         if (p->field.avl_left) {                                                                       \
-            max_LC_high   = p->field.avl_left->max_high;                                                \
-         }                                                                                              \
-                                                                                                        \
-         if (max_self_high > max_high) {max_high = max_self_high;}                                      \
-         if (max_LC_high   > max_high) {max_high = max_LC_high;}                                        \
-                                                                                                        \
-         if (p->max_high > max_high) {                                                                  \
-	    p->max_high = max_high;                                                                     \
-	    t=p->field.parent;                                                                          \
-	    p=t;                                                                                        \
-         }                                                                                              \
+       if (p->field.avl_right && (p->field.avl_right->max_high > max_high)) {                           \
+          max_high = p->field.avl_right->max_high;                                                      \
        }                                                                                                \
-    }                                                                                                   \
+       if ((p != self) && (p->max_high == max_high)) {                                                  \
+          break;                                                                                        \
+       }                                                                                                \
+       p->max_high = max_high;                                                                          \
     }                                                                                                   \
   }                                                                                                     \
                                                                                                         \
@@ -346,6 +330,10 @@ void INT_FIX_MAX_HIGH_##node##_##field(struct node *self)
                                                                                                         \
     if (!self) {								                        \
       elm->max_high = elm->high;						                        \
+      elm->field.avl_left = 0;                                                                          \
+      elm->field.avl_right = 0;                                                                         \
+      elm->field.avl_height = 1;                                                                        \
+      elm->field.parent = 0;                                                                            \
       return elm;                                                                                       \
     }											                \
     if (compare(elm, self) < 0) {					                                \
@@ -384,6 +372,11 @@ unsigned long long INT_MAX_INTERSECT_##node##_##field
     if (self->max_high < elm->low) {                                                                    \
       return 0;                                                                                         \
     }                                                                                                   \
+                                                                                                        \
+ /* in order: the left subtree, self, then the right subtree unless it starts after elm ends */         \
+                                                                                                        \
+    left_local=INT_MAX_INTERSECT_##node##_##field(self->field.avl_left, elm);                           \
+                                                                                                        \
     if ((elm->low <= self->high) && (elm->high >= self->low)) {                                         \
                                                                                                         \
 /* left inside, right outside */                                                                        \
@@ -410,36 +403,21 @@ if ((elm->low <= self->low) && (elm->high >= self->high)) {
     local_int=(self->high - self->low);					                                \
 }                                                                                                       \
                                                                                                         \
- if ((self->field.avl_left) && (BOOL_INT_INTERSECT_##node##_##field(self->field.avl_left,elm))) {       \
-    left_local=INT_MAX_INTERSECT_##node##_##field(self->field.avl_left,elm);                            \
- }                                                                                                      \
+    }                                                                                                   \
                                                                                                         \
- if ((self->field.avl_right) && (BOOL_INT_INTERSECT_##node##_##field(self->field.avl_right,elm))) {     \
-    right_local=INT_MAX_INTERSECT_##node##_##field(self->field.avl_left,elm);                           \
- }                                                                                                      \
+    if (self->low <= elm->high) {                                                                       \
+      right_local=INT_MAX_INTERSECT_##node##_##field(self->field.avl_right, elm);                       \
+    }                                                                                                   \
                                                                                                         \
  if (local_int   > local_max) {local_max = local_int;}                                                  \
  if (left_local  > local_max) {local_max = left_local;}                                                 \
  if (right_local > local_max) {local_max = right_local;}                                                \
                                                                                                         \
- /*    printf("E: %llu %llu S: %llu %llu\n",elm->low, elm->high, self->low, self->high); */             \
-      return local_max;                                                                                 \
-    }                                                                                                   \
-                                                                                                        \
-    if (self->low > elm->high) {                                                                        \
-      return INT_MAX_INTERSECT_##node##_##field(self->field.avl_left, elm);                             \
-    }                                                                                                   \
-    else {                                                                                              \
-      if (INT_MAX_INTERSECT_##node##_##field(self->field.avl_right, elm) == 0) {                        \
-	return INT_MAX_INTERSECT_##node##_##field(self->field.avl_left, elm);                           \
-      }                                                                                                 \
-      else {                                                                                            \
-        return INT_MAX_INTERSECT_##node##_##field(self->field.avl_right, elm);                          \
-      }                                                                                                 \
-    }                                                                                                   \
+    return local_max;                                                                                   \
   }                                                                                                     \
 unsigned long long INT_ALL_INTERSECT_##node##_##field                                                   \
-    (struct node *self, struct node *elm)                                                               \
+    (struct node *self, struct node *elm,                                                               \
+     void (*function)(struct node *node, unsigned long long len, void *data), void *data)               \
   {                                                                                                     \
                                                                                                         \
   unsigned long long local_max, local_int, left_local, right_local;	                                \
@@ -455,63 +433,50 @@ unsigned long long INT_ALL_INTERSECT_##node##_##field
     if (self->max_high < elm->low) {                                                                    \
       return 0;                                                                                         \
     }                                                                                                   \
+                                                                                                        \
+ /* in order: the left subtree, self, then the right subtree unless it starts after elm ends */         \
+                                                                                                        \
+    left_local=INT_ALL_INTERSECT_##node##_##field(self->field.avl_left, elm, function, data);           \
+                                                                                                        \
     if ((elm->low <= self->high) && (elm->high >= self->low)) {                                         \
                                                                                                         \
 /* left inside, right outside */                                                                        \
                                                                                                         \
 if ((elm->low >= self->low) && (elm->high >= self->high)) {                                             \
   local_int=(self->high - elm->low);                                                                    \
-  printf("I %llu\n",local_int);                                                                         \
  }                                                                                                      \
                                                                                                         \
 /* left inside, right inside */                                                                         \
                                                                                                         \
 if ((elm->low >= self->low) && (elm->high <= self->high)) {                                             \
   local_int=(elm->high - elm->low);                                                                     \
-  printf("I %llu\n",local_int);                                                                         \
 }                                                                                                       \
                                                                                                         \
 /* left outside, right inside */                                                                        \
                                                                                                         \
 if ((elm->low <= self->low) && (elm->high <= self->high)) {                                             \
   local_int=(elm->high - self->low);                                                                    \
-  printf("I %llu\n",local_int);                                                                         \
 }                                                                                                       \
                                                                                                         \
 /* left outside, right outside */                                                                       \
                                                                                                         \
 if ((elm->low <= self->low) && (elm->high >= self->high)) {                                             \
     local_int=(self->high - self->low);					                                \
-    printf("I %llu\n",local_int);                                                                       \
 }                                                                                                       \
                                                                                                         \
- if ((self->field.avl_left) && (BOOL_INT_INTERSECT_##node##_##field(self->field.avl_left,elm))) {       \
-    left_local=INT_ALL_INTERSECT_##node##_##field(self->field.avl_left,elm);                            \
- }                                                                                                      \
+ if (function) {function(self, local_int, data);}                                                       \
                                                                                                         \
- if ((self->field.avl_right) && (BOOL_INT_INTERSECT_##node##_##field(self->field.avl_right,elm))) {     \
-    right_local=INT_ALL_INTERSECT_##node##_##field(self->field.avl_left,elm);                           \
- }                                                                                                      \
+    }                                                                                                   \
+                                                                                                        \
+    if (self->low <= elm->high) {                                                                       \
+      right_local=INT_ALL_INTERSECT_##node##_##field(self->field.avl_right, elm, function, data);       \
+    }                                                                                                   \
                                                                                                         \
  if (local_int   > local_max) {local_max = local_int;}                                                  \
  if (left_local  > local_max) {local_max = left_local;}                                                 \
  if (right_local > local_max) {local_max = right_local;}                                                \
                                                                                                         \
- /*    printf("E: %llu %llu S: %llu %llu\n",elm->low, elm->high, self->low, self->high); */             \
-      return local_max;                                                                                 \
-    }                                                                                                   \
-                                                                                                        \
-    if (self->low > elm->high) {                                                                        \
-      return INT_ALL_INTERSECT_##node##_##field(self->field.avl_left, elm);                             \
-    }                                                                                                   \
-    else {                                                                                              \
-      if (INT_ALL_INTERSECT_##node##_##field(self->field.avl_right, elm) == 0) {                        \
-	return INT_ALL_INTERSECT_##node##_##field(self->field.avl_left, elm);                           \
-      }                                                                                                 \
-      else {                                                                                            \
-        return INT_ALL_INTERSECT_##node##_##field(self->field.avl_right, elm);                          \
-      }                                                                                                 \
-    }                                                                                                   \
+    return local_max;                                                                                   \
   }                                                                                                     \
                                                                                                         \
  /* the query node is elm. the question is whether or not anything from */                              \
@@ -536,6 +501,11 @@ unsigned long long INT_MAX_CONTAINMENT_##node##_##field
     if (self->max_high < elm->low) {                                                                    \
       return 0;                                                                                         \
     }                                                                                                   \
+                                                                                                        \
+ /* in order: the left subtree, self, then the right subtree unless it starts after elm ends */         \
+                                                                                                        \
+    left_local=INT_MAX_CONTAINMENT_##node##_##field(self->field.avl_left, elm);                         \
+                                                                                                        \
     if ((elm->low <= self->high) && (elm->high >= self->low)) {                                         \
                                                                                                         \
 /* left inside, right outside */                                                                        \
@@ -570,36 +540,21 @@ if (local_A>local_B) {
  }                                                                                                      \
 }                                                                                                       \
                                                                                                         \
- if ((self->field.avl_left) && (BOOL_INT_INTERSECT_##node##_##field(self->field.avl_left,elm))) {       \
-    left_local=INT_MAX_CONTAINMENT_##node##_##field(self->field.avl_left,elm);                          \
- }                                                                                                      \
+    }                                                                                                   \
                                                                                                         \
- if ((self->field.avl_right) && (BOOL_INT_INTERSECT_##node##_##field(self->field.avl_right,elm))) {     \
-    right_local=INT_MAX_CONTAINMENT_##node##_##field(self->field.avl_left,elm);                         \
- }                                                                                                      \
+    if (self->low <= elm->high) {                                                                       \
+      right_local=INT_MAX_CONTAINMENT_##node##_##field(self->field.avl_right, elm);                     \
+    }                                                                                                   \
                                                                                                         \
  if (local_int   > local_max) {local_max = local_int;}                                                  \
  if (left_local  > local_max) {local_max = left_local;}                                                 \
  if (right_local > local_max) {local_max = right_local;}                                                \
                                                                                                         \
- /*    printf("E: %llu %llu S: %llu %llu\n",elm->low, elm->high, self->low, self->high); */             \
-      return local_max;                                                                                 \
-    }                                                                                                   \
-                                                                                                        \
-    if (self->low > elm->high) {                                                                        \
-      return INT_MAX_CONTAINMENT_##node##_##field(self->field.avl_left, elm);                           \
-    }                                                                                                   \
-    else {                                                                                              \
-      if (INT_MAX_CONTAINMENT_##node##_##field(self->field.avl_right, elm) == 0) {                      \
-	return INT_MAX_CONTAINMENT_##node##_##field(self->field.avl_left, elm);                         \
-      }                                                                                                 \
-      else {                                                                                            \
-        return INT_MAX_CONTAINMENT_##node##_##field(self->field.avl_right, elm);                        \
-      }                                                                                                 \
-    }                                                                                                   \
+    return local_max;                                                                                   \
   }                                                                                                     \
 unsigned long long INT_ALL_CONTAINMENT_##node##_##field                                                 \
-    (struct node *self, struct node *elm)                                                               \
+    (struct node *self, struct node *elm,                                                               \
+     void (*function)(struct node *node, unsigned long long len, void *data), void *data)               \
   {                                                                                                     \
                                                                                                         \
     unsigned long long local_max, local_int, left_local, right_local, local_A, local_B;	                \
@@ -617,6 +572,11 @@ unsigned long long INT_ALL_CONTAINMENT_##node##_##field
     if (self->max_high < elm->low) {                                                                    \
       return 0;                                                                                         \
     }                                                                                                   \
+                                                                                                        \
+ /* in order: the left subtree, self, then the right subtree unless it starts after elm ends */         \
+                                                                                                        \
+    left_local=INT_ALL_CONTAINMENT_##node##_##field(self->field.avl_left, elm, function, data);         \
+                                                                                                        \
     if ((elm->low <= self->high) && (elm->high >= self->low)) {                                         \
                                                                                                         \
 /* left inside, right outside */                                                                        \
@@ -648,36 +608,113 @@ if (local_A>local_B) {
  else {                                                                                                 \
    local_int=local_A;                                                                                   \
  }                                                                                                      \
-  printf("I %llu\n",local_int);							                        \
+ if (function) {function(self, local_int, data);}                                                       \
 }                                                                                                       \
                                                                                                         \
- if ((self->field.avl_left) && (BOOL_INT_INTERSECT_##node##_##field(self->field.avl_left,elm))) {       \
-    left_local=INT_ALL_CONTAINMENT_##node##_##field(self->field.avl_left,elm);                          \
- }                                                                                                      \
+    }                                                                                                   \
                                                                                                         \
- if ((self->field.avl_right) && (BOOL_INT_INTERSECT_##node##_##field(self->field.avl_right,elm))) {     \
-    right_local=INT_ALL_CONTAINMENT_##node##_##field(self->field.avl_left,elm);                         \
- }                                                                                                      \
+    if (self->low <= elm->high) {                                                                       \
+      right_local=INT_ALL_CONTAINMENT_##node##_##field(self->field.avl_right, elm, function, data);     \
+    }                                                                                                   \
                                                                                                         \
  if (local_int   > local_max) {local_max = local_int;}                                                  \
  if (left_local  > local_max) {local_max = left_local;}                                                 \
  if (right_local > local_max) {local_max = right_local;}                                                \
                                                                                                         \
- /*    printf("E: %llu %llu S: %llu %llu\n",elm->low, elm->high, self->low, self->high); */             \
-      return local_max;                                                                                 \
+    return local_max;                                                                                   \
+  }                                                                                                     \
+                                                                                                        \
+ /* top-k overlap: the k nodes from self downward with the longest overlap with elm.  nodes[]    */     \
+ /* and scores[] hold a min-heap on score while the search runs, so scores[0] is the k-th best   */     \
+ /* so far, and a subtree is skipped when the longest overlap it could hold cannot beat that.    */     \
+ /* no overlap in the subtree starts before lob->low (compare must order by low); lob is a       */     \
+ /* node rather than a number so the bound keeps the type of the coordinates, signed or not      */     \
+                                                                                                        \
+void INT_TOPK_SIFT_##node##_##field                                                                     \
+  (struct node **nodes, unsigned long long *scores, int i, int n)                                       \
+  {                                                                                                     \
+    struct node *tn;                                                                                    \
+    unsigned long long ts;                                                                              \
+    int c;                                                                                              \
+                                                                                                        \
+    while ((c= 2*i + 1) < n) {                                                                          \
+      if ((c + 1 < n) && (scores[c + 1] < scores[c]))                                                   \
+        c++;                                                                                            \
+      if (scores[i] <= scores[c])                                                                       \
+        break;                                                                                          \
+      tn= nodes[i]; nodes[i]= nodes[c]; nodes[c]= tn;                                                   \
+      ts= scores[i]; scores[i]= scores[c]; scores[c]= ts;                                               \
+      i= c;                                                                                             \
     }                                                                                                   \
+  }                                                                                                     \
                                                                                                         \
-    if (self->low > elm->high) {                                                                        \
-      return INT_ALL_CONTAINMENT_##node##_##field(self->field.avl_left, elm);                           \
+void INT_TOPK_SEARCH_##node##_##field                                                                   \
+  (struct node *self, struct node *elm, struct node *lob,                                               \
+   struct node **nodes, unsigned long long *scores, int k, int *count)                                  \
+  {                                                                                                     \
+    unsigned long long bound, len;                                                                      \
+    int i, p;                                                                                           \
+                                                                                                        \
+    if (!self) {                                                                                        \
+      return;                                                                                           \
     }                                                                                                   \
-    else {                                                                                              \
-      if (INT_ALL_CONTAINMENT_##node##_##field(self->field.avl_right, elm) == 0) {                      \
-	return INT_ALL_CONTAINMENT_##node##_##field(self->field.avl_left, elm);                         \
+    if (self->max_high < elm->low) {                                                                    \
+      return;                                                                                           \
+    }                                                                                                   \
+    if (((self->max_high < elm->high) ? self->max_high : elm->high) < lob->low) {                       \
+      return;                                                                                           \
+    }                                                                                                   \
+    bound= ((self->max_high < elm->high) ? self->max_high : elm->high) - lob->low;                      \
+    if ((*count == k) && (bound <= scores[0])) {                                                        \
+      return;                                                                                           \
+    }                                                                                                   \
+    if ((elm->low <= self->high) && (elm->high >= self->low)) {                                         \
+      len= ((self->high < elm->high) ? self->high : elm->high)                                          \
+         - ((self->low  > elm->low)  ? self->low  : elm->low);                                          \
+      if (*count < k) {                                                                                 \
+        for (i= (*count)++; i > 0; i= p) {                                                              \
+          p= (i - 1) / 2;                                                                               \
+          if (scores[p] <= len) break;                                                                  \
+          nodes[i]= nodes[p];                                                                           \
+          scores[i]= scores[p];                                                                         \
+        }                                                                                               \
+        nodes[i]= self;                                                                                 \
+        scores[i]= len;                                                                                 \
       }                                                                                                 \
-      else {                                                                                            \
-        return INT_ALL_CONTAINMENT_##node##_##field(self->field.avl_right, elm);                        \
+      else if (len > scores[0]) {                                                                       \
+        nodes[0]= self;                                                                                 \
+        scores[0]= len;                                                                                 \
+        INT_TOPK_SIFT_##node##_##field(nodes, scores, 0, k);                                            \
       }                                                                                                 \
     }                                                                                                   \
+    INT_TOPK_SEARCH_##node##_##field(self->field.avl_left, elm, lob, nodes, scores, k, count);          \
+    if (self->low > elm->high) {                                                                        \
+      return;                                                                                           \
+    }                                                                                                   \
+    INT_TOPK_SEARCH_##node##_##field(self->field.avl_right, elm, (self->low > lob->low) ? self : lob,   \
+                                     nodes, scores, k, count);                                          \
+  }                                                                                                     \
+                                                                                                        \
+ /* fills nodes[] and scores[] best first and returns how many were found (at most k) */                \
+                                                                                                        \
+int INT_TOPK_INTERSECT_##node##_##field                                                                 \
+  (struct node *self, struct node *elm, struct node **nodes, unsigned long long *scores, int k)         \
+  {                                                                                                     \
+    struct node *tn;                                                                                    \
+    unsigned long long ts;                                                                              \
+    int count= 0;                                                                                       \
+    int i;                                                                                              \
+                                                                                                        \
+    if (k <= 0) {                                                                                       \
+      return 0;                                                                                         \
+    }                                                                                                   \
+    INT_TOPK_SEARCH_##node##_##field(self, elm, elm, nodes, scores, k, &count);                         \
+    for (i= count - 1; i > 0; i--) {                                                                    \
+      tn= nodes[0]; nodes[0]= nodes[i]; nodes[i]= tn;                                                   \
+      ts= scores[0]; scores[0]= scores[i]; scores[i]= ts;                                               \
+      INT_TOPK_SIFT_##node##_##field(nodes, scores, 0, i);                                              \
+    }                                                                                                   \
+    return count;                                                                                       \
   }                                                                                                     \
                                                                                                         \
 struct node *INT_INTERSECT_##node##_##field                                                             \
@@ -734,14 +771,131 @@ unsigned int BOOL_INT_INTERSECT_##node##_##field
     }                                                                                                   \
   }                                                                                                     \
                                                                                                         \
+ /* iterators.  these walk the parent links kept by the INT_TREE_ functions, so they need no */         \
+ /* stack or heap and may be stopped and resumed at will.  a node pointer stays a valid      */         \
+ /* position for as long as the tree is not modified.  TREE_INSERT and TREE_REMOVE keep no   */         \
+ /* parent links, so a tree to be iterated must be built with INT_TREE_INSERT                */         \
+                                                                                                        \
+struct node *INT_TREE_FIRST_##node##_##field(struct node *self)                                         \
+  {                                                                                                     \
+    if (self) {                                                                                         \
+      while (self->field.avl_left) {self= self->field.avl_left;}                                        \
+    }                                                                                                   \
+    return self;                                                                                        \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT_TREE_LAST_##node##_##field(struct node *self)                                          \
+  {                                                                                                     \
+    if (self) {                                                                                         \
+      while (self->field.avl_right) {self= self->field.avl_right;}                                      \
+    }                                                                                                   \
+    return self;                                                                                        \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT_TREE_NEXT_##node##_##field(struct node *self)                                          \
+  {                                                                                                     \
+    if (self->field.avl_right) {                                                                        \
+      return INT_TREE_FIRST_##node##_##field(self->field.avl_right);                                    \
+    }                                                                                                   \
+    while (self->field.parent && (self->field.parent->field.avl_right == self)) {                       \
+      self= self->field.parent;                                                                         \
+    }                                                                                                   \
+    return self->field.parent;                                                                          \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT_TREE_PREV_##node##_##field(struct node *self)                                          \
+  {                                                                                                     \
+    if (self->field.avl_left) {                                                                         \
+      return INT_TREE_LAST_##node##_##field(self->field.avl_left);                                      \
+    }                                                                                                   \
+    while (self->field.parent && (self->field.parent->field.avl_left == self)) {                        \
+      self= self->field.parent;                                                                         \
+    }                                                                                                   \
+    return self->field.parent;                                                                          \
+  }                                                                                                     \
+                                                                                                        \
+ /* overlap cursors: the same in-order walk, restricted to nodes that intersect elm.  subtrees */       \
+ /* whose max_high falls short of elm are never entered, and the walk ends at the first node   */       \
+ /* that starts after elm does (compare must order by low)                                     */       \
+                                                                                                        \
+struct node *INT_OVERLAP_LEFTMOST_##node##_##field(struct node *self, struct node *elm)                 \
+  {                                                                                                     \
+    if (!self || (self->max_high < elm->low)) {                                                         \
+      return 0;                                                                                         \
+    }                                                                                                   \
+    while (self->field.avl_left && (self->field.avl_left->max_high >= elm->low)) {                      \
+      self= self->field.avl_left;                                                                       \
+    }                                                                                                   \
+    return self;                                                                                        \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT_OVERLAP_SCAN_##node##_##field(struct node *self, struct node *elm)                     \
+  {                                                                                                     \
+    struct node *n;                                                                                     \
+                                                                                                        \
+    while (self) {                                                                                      \
+      if (self->low > elm->high) {                                                                      \
+        return 0;                                                                                       \
+      }                                                                                                 \
+      if (self->high >= elm->low) {                                                                     \
+        return self;                                                                                    \
+      }                                                                                                 \
+      if ((n= INT_OVERLAP_LEFTMOST_##node##_##field(self->field.avl_right, elm))) {                     \
+        self= n;                                                                                        \
+        continue;                                                                                       \
+      }                                                                                                 \
+      while (self->field.parent && (self->field.parent->field.avl_right == self)) {                     \
+        self= self->field.parent;                                                                       \
+      }                                                                                                 \
+      self= self->field.parent;                                                                         \
+    }                                                                                                   \
+    return 0;                                                                                           \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT_OVERLAP_FIRST_##node##_##field(struct node *self, struct node *elm)                    \
+  {                                                                                                     \
+    return INT_OVERLAP_SCAN_##node##_##field(INT_OVERLAP_LEFTMOST_##node##_##field(self, elm), elm);    \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT_OVERLAP_NEXT_##node##_##field(struct node *self, struct node *elm)                     \
+  {                                                                                                     \
+    struct node *n= INT_OVERLAP_LEFTMOST_##node##_##field(self->field.avl_right, elm);                  \
+                                                                                                        \
+    if (!n) {                                                                                           \
+      while (self->field.parent && (self->field.parent->field.avl_right == self)) {                     \
+        self= self->field.parent;                                                                       \
+      }                                                                                                 \
+      n= self->field.parent;                                                                            \
+    }                                                                                                   \
+    return INT_OVERLAP_SCAN_##node##_##field(n, elm);                                                   \
+  }                                                                                                     \
+                                                                                                        \
+ /* copies up to max overlapping nodes, starting at *cursor, into buf and leaves *cursor at the */      \
+ /* first one not copied (0 once the query is exhausted).  returns the number copied            */      \
+                                                                                                        \
+int INT_OVERLAP_PAGE_##node##_##field                                                                   \
+    (struct node **cursor, struct node *elm, struct node **buf, int max)                                \
+  {                                                                                                     \
+    struct node *n= *cursor;                                                                            \
+    int count= 0;                                                                                       \
+                                                                                                        \
+    while (n && (count < max)) {                                                                        \
+      buf[count++]= n;                                                                                  \
+      n= INT_OVERLAP_NEXT_##node##_##field(n, elm);                                                     \
+    }                                                                                                   \
+    *cursor= n;                                                                                         \
+    return count;                                                                                       \
+  }                                                                                                     \
+                                                                                                        \
 struct node *INT_TREE_MOVE_RIGHT(struct node *self, struct node *rhs)	                                \
   {													\
     if (!self) {							                                \
       return rhs;											\
     }                                                                                                   \
     self->field.avl_right= INT_TREE_MOVE_RIGHT(self->field.avl_right, rhs);				\
-       INT_FIX_MAX_HIGH_##node##_##field(self->field.avl_right);                                        \
-       INT_FIX_MAX_HIGH_##node##_##field(self);                                                         \
+    if (self->field.avl_right) {self->field.avl_right->field.parent= self;}                             \
+       INT_SET_MAX_HIGH_##node##_##field(self->field.avl_right);                                        \
+       INT_SET_MAX_HIGH_##node##_##field(self);                                                         \
     return INT_TREE_BALANCE_##node##_##field(self);							\
   }													\
                                                                                                         \
@@ -755,12 +909,15 @@ struct node *INT_TREE_REMOVE_##node##_##field
       {													\
     /* printf("C\n"); */						                                \
 	struct node *tmp= INT_TREE_MOVE_RIGHT(self->field.avl_left, self->field.avl_right);		\
+	struct node *p= self->field.parent;                                                             \
 	self->field.avl_left= 0;									\
 	self->field.avl_right= 0;									\
 	/* printf("F\n"); */						                                \
-	   INT_FIX_MAX_HIGH_##node##_##field(self);		                                        \
+	self->field.parent= 0;                                                                          \
+	   INT_SET_MAX_HIGH_##node##_##field(self);		                                        \
 	/* printf("G\n");  */                                                                           \
-	   INT_FIX_MAX_HIGH_##node##_##field(tmp);                                                      \
+	if (tmp) {tmp->field.parent= p;}                                                                \
+	   INT_SET_MAX_HIGH_##node##_##field(tmp);                                                      \
 	/* printf("H\n"); */                                                                            \
                                                                                                         \
 	return tmp;											\
@@ -768,54 +925,1184 @@ struct node *INT_TREE_REMOVE_##node##_##field
     if (compare(elm, self) < 0)	{					                                \
       /*     printf("D\n"); */						                                \
       self->field.avl_left= INT_TREE_REMOVE_##node##_##field(self->field.avl_left, elm, compare);	\
+      if (self->field.avl_left) {self->field.avl_left->field.parent= self;}                             \
          INT_FIX_MAX_HIGH_##node##_##field(self->field.avl_left);                                       \
     }                                                                                                   \
     else {								                                \
       /*     printf("E\n"); */						                                \
       self->field.avl_right= INT_TREE_REMOVE_##node##_##field(self->field.avl_right, elm, compare);	\
+      if (self->field.avl_right) {self->field.avl_right->field.parent= self;}                           \
          INT_FIX_MAX_HIGH_##node##_##field(self->field.avl_right);                                      \
     }                                                                                                   \
     return INT_TREE_BALANCE_##node##_##field(self);							\
   }													\
-
-#define TREE_INSERT(head, node, field, elm)						                \
-  ((head)->th_root= TREE_INSERT_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
-
-#define INT_TREE_INSERT(head, node, field, elm)						                \
-  ((head)->th_root= INT_TREE_INSERT_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
-
-#define TREE_FIND(head, node, field, elm)				                                \
-  (TREE_FIND_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
-
-#define INT_INTERSECT(head, node, field, elm)				                                \
-  (INT_INTERSECT_##node##_##field((head)->th_root, (elm)))
-
-#define BOOL_INT_INTERSECT(head, node, field, elm)				                        \
-  (BOOL_INT_INTERSECT_##node##_##field((head)->th_root, (elm)))
-
-#define INT_MAX__INTERSECT(head, node, field, elm)				                        \
-  (INT_MAX_INTERSECT_##node##_##field((head)->th_root, (elm)))
-
-#define INT_MAX__CONTAINMENT(head, node, field, elm)				                        \
-  (INT_MAX_CONTAINMENT_##node##_##field((head)->th_root, (elm)))
-
-#define TREE_REMOVE(head, node, field, elm)						                \
-  ((head)->th_root= TREE_REMOVE_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
-#define INT_TREE_REMOVE(head, node, field, elm)						                \
-  ((head)->th_root= INT_TREE_REMOVE_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
-
-#define TREE_DEPTH(head, field)			                                                        \
-  ((head)->th_root->field.avl_height)
-
-#define TREE_FORWARD_APPLY(head, node, field, function, data)	                                        \
-  TREE_FORWARD_APPLY_ALL_##node##_##field((head)->th_root, function, data)
-
-#define TREE_REVERSE_APPLY(head, node, field, function, data)	                                        \
-  TREE_REVERSE_APPLY_ALL_##node##_##field((head)->th_root, function, data)
-
-#define TREE_INIT(head, cmp) do {		                                                        \
-    (head)->th_root= 0;				                                                        \
-    (head)->th_cmp= (cmp);			                                                        \
-  } while (0)
+                                                                                                        \
+ /* bulk removal.  matching nodes are detached and handed back as a list threaded through   */          \
+ /* field.avl_right, in order.  a key range is contiguous, so it is cut out with two splits */          \
+ /* and one join.  overlaps are not: while they are few they are unlinked one at a time,    */          \
+ /* and once there are more than about n/log n of them the rest of the tree is taken apart  */          \
+ /* and rebuilt perfectly balanced in a single linear pass instead                          */          \
+                                                                                                        \
+ /* removes exactly elm (not merely some node comparing equal to it) from self downward.  elm */        \
+ /* is reached through its parent links rather than by comparison, and the tree is          */          \
+ /* rebalanced going back up that same chain                                                 */         \
+                                                                                                        \
+struct node *INT_TREE_REMOVE_NODE_##node##_##field(struct node *self, struct node *elm)                 \
+  {                                                                                                     \
+    struct node *tmp;                                                                                   \
+    struct node *old;                                                                                   \
+    struct node *p;                                                                                     \
+                                                                                                        \
+    for (p= elm; p && (p != self); p= p->field.parent)                                                  \
+      ;                                                                                                 \
+    if (!p) {                                                                                           \
+      return self;                                                                                      \
+    }                                                                                                   \
+    tmp= INT_TREE_MOVE_RIGHT(elm->field.avl_left, elm->field.avl_right);                                \
+    p= elm->field.parent;                                                                               \
+    elm->field.avl_left= 0;                                                                             \
+    elm->field.avl_right= 0;                                                                            \
+    elm->field.parent= 0;                                                                               \
+       INT_SET_MAX_HIGH_##node##_##field(elm);                                                          \
+    if (tmp) {tmp->field.parent= p;}                                                                    \
+    for (old= elm; old != self; old= p, p= tmp->field.parent) {                                         \
+      if (p->field.avl_left == old)                                                                     \
+        p->field.avl_left= tmp;                                                                         \
+      else                                                                                              \
+        p->field.avl_right= tmp;                                                                        \
+      if (tmp) {tmp->field.parent= p;}                                                                  \
+         INT_SET_MAX_HIGH_##node##_##field(p);                                                          \
+      tmp= INT_TREE_BALANCE_##node##_##field(p);                                                        \
+    }                                                                                                   \
+    return tmp;                                                                                         \
+  }                                                                                                     \
+                                                                                                        \
+                                                                                                        \
+ /* splits the nodes from self downward, in order, onto the kept and dropped lists */                   \
+                                                                                                        \
+void INT_TREE_PARTITION_##node##_##field                                                                \
+    (struct node *self, int (*pred)(struct node *node, void *data), void *data,                         \
+     struct node ***keep, struct node ***drop, int *nkeep)                                              \
+  {                                                                                                     \
+    struct node *r;                                                                                     \
+                                                                                                        \
+    if (!self) {                                                                                        \
+      return;                                                                                           \
+    }                                                                                                   \
+    r= self->field.avl_right;                                                                           \
+    INT_TREE_PARTITION_##node##_##field(self->field.avl_left, pred, data, keep, drop, nkeep);           \
+    self->field.avl_left= 0;                                                                            \
+    self->field.avl_right= 0;                                                                           \
+    self->field.parent= 0;                                                                              \
+    if (pred(self, data)) {                                                                             \
+      **drop= self;                                                                                     \
+      *drop= &self->field.avl_right;                                                                    \
+    }                                                                                                   \
+    else {                                                                                              \
+      **keep= self;                                                                                     \
+      *keep= &self->field.avl_right;                                                                    \
+      *nkeep += 1;                                                                                      \
+    }                                                                                                   \
+    INT_TREE_PARTITION_##node##_##field(r, pred, data, keep, drop, nkeep);                              \
+  }                                                                                                     \
+                                                                                                        \
+ /* builds a balanced tree from the first n nodes of an ordered list, advancing *list past them */      \
+                                                                                                        \
+struct node *INT_TREE_BUILD_##node##_##field(struct node **list, int n)                                 \
+  {                                                                                                     \
+    struct node *self;                                                                                  \
+    struct node *l;                                                                                     \
+    struct node *r;                                                                                     \
+                                                                                                        \
+    if (n <= 0) {                                                                                       \
+      return 0;                                                                                         \
+    }                                                                                                   \
+    l= INT_TREE_BUILD_##node##_##field(list, n / 2);                                                    \
+    self= *list;                                                                                        \
+    *list= self->field.avl_right;                                                                       \
+    r= INT_TREE_BUILD_##node##_##field(list, n - n / 2 - 1);                                            \
+                                                                                                        \
+    self->field.avl_left= l;                                                                            \
+    self->field.avl_right= r;                                                                           \
+    self->field.parent= 0;                                                                              \
+    self->field.avl_height= 1;                                                                          \
+    self->max_high= self->high;                                                                         \
+    if (l) {                                                                                            \
+      l->field.parent= self;                                                                            \
+      self->field.avl_height= l->field.avl_height + 1;                                                  \
+      if (l->max_high > self->max_high) {self->max_high= l->max_high;}                                  \
+    }                                                                                                   \
+    if (r) {                                                                                            \
+      r->field.parent= self;                                                                            \
+      if (r->field.avl_height >= self->field.avl_height) {                                              \
+        self->field.avl_height= r->field.avl_height + 1;                                                \
+      }                                                                                                 \
+      if (r->max_high > self->max_high) {self->max_high= r->max_high;}                                  \
+    }                                                                                                   \
+    return self;                                                                                        \
+  }                                                                                                     \
+                                                                                                        \
+ /* removes every node for which pred is true, in one linear pass.  *removed receives the list */       \
+                                                                                                        \
+struct node *INT_TREE_REMOVE_IF_##node##_##field                                                        \
+    (struct node *self, int (*pred)(struct node *node, void *data), void *data, struct node **removed)  \
+  {                                                                                                     \
+    struct node *kept= 0;                                                                               \
+    struct node **keep= &kept;                                                                          \
+    struct node **drop= removed;                                                                        \
+    int n= 0;                                                                                           \
+                                                                                                        \
+    INT_TREE_PARTITION_##node##_##field(self, pred, data, &keep, &drop, &n);                            \
+    *keep= 0;                                                                                           \
+    *drop= 0;                                                                                           \
+    return INT_TREE_BUILD_##node##_##field(&kept, n);                                                   \
+  }                                                                                                     \
+                                                                                                        \
+ /* how many one-at-a-time removals to allow before rebuilding: the fewest nodes an AVL tree */         \
+ /* of this height can hold, divided by the height                                           */         \
+                                                                                                        \
+int INT_TREE_BULK_LIMIT_##node##_##field(struct node *self)                                             \
+  {                                                                                                     \
+    unsigned long long a= 0, b= 1, t;                                                                   \
+    int h, i;                                                                                           \
+                                                                                                        \
+    if (!self) {                                                                                        \
+      return 0;                                                                                         \
+    }                                                                                                   \
+    h= self->field.avl_height;                                                                          \
+    for (i= 1; (i < h) && (b < (1ULL << 62)); i++) {                                                    \
+      t= a + b + 1;                                                                                     \
+      a= b;                                                                                             \
+      b= t;                                                                                             \
+    }                                                                                                   \
+    return (int)((b / h) < 0x7fffffff ? (b / h) : 0x7fffffff);                                          \
+  }                                                                                                     \
+                                                                                                        \
+ /* first(self, data) finds a node that still matches, pred(node, data) tests a single node */          \
+                                                                                                        \
+struct node *INT_TREE_BULK_REMOVE_##node##_##field                                                      \
+    (struct node *self, struct node *(*first)(struct node *self, void *data),                           \
+     int (*pred)(struct node *node, void *data), void *data, struct node **removed)                     \
+  {                                                                                                     \
+    struct node *m;                                                                                     \
+    int limit= INT_TREE_BULK_LIMIT_##node##_##field(self);                                              \
+    int k= 0;                                                                                           \
+                                                                                                        \
+    while ((m= first(self, data))) {                                                                    \
+      if (++k > limit) {                                                                                \
+        return INT_TREE_REMOVE_IF_##node##_##field(self, pred, data, removed);                          \
+      }                                                                                                 \
+      self= INT_TREE_REMOVE_NODE_##node##_##field(self, m);                                             \
+      *removed= m;                                                                                      \
+      removed= &m->field.avl_right;                                                                     \
+    }                                                                                                   \
+    *removed= 0;                                                                                        \
+    return self;                                                                                        \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT_OVERLAP_FIRST_DATA_##node##_##field(struct node *self, void *data)                     \
+  {                                                                                                     \
+    return INT_OVERLAP_FIRST_##node##_##field(self, (struct node *)data);                               \
+  }                                                                                                     \
+                                                                                                        \
+int INT_OVERLAP_PRED_##node##_##field(struct node *self, void *data)                                    \
+  {                                                                                                     \
+    struct node *elm= (struct node *)data;                                                              \
+                                                                                                        \
+    return (elm->low <= self->high) && (elm->high >= self->low);                                        \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT_TREE_REMOVE_OVERLAPS_##node##_##field                                                  \
+    (struct node *self, struct node *elm, struct node **removed)                                        \
+  {                                                                                                     \
+    return INT_TREE_BULK_REMOVE_##node##_##field(self, INT_OVERLAP_FIRST_DATA_##node##_##field,         \
+                                                 INT_OVERLAP_PRED_##node##_##field, elm, removed);      \
+  }                                                                                                     \
+                                                                                                        \
+ /* joins l, m and r into one balanced tree; every node of l orders before m and every node */          \
+ /* of r after it.  the descent follows the taller tree's inner edge down to the height of  */          \
+ /* the shorter one, so the cost is the difference in their heights                        */           \
+                                                                                                        \
+struct node *INT_TREE_JOIN_##node##_##field(struct node *l, struct node *m, struct node *r)             \
+  {                                                                                                     \
+    int hl= l ? l->field.avl_height : 0;                                                                \
+    int hr= r ? r->field.avl_height : 0;                                                                \
+                                                                                                        \
+    if (hl > hr + TREE_DELTA_MAX) {                                                                     \
+      l->field.avl_right= INT_TREE_JOIN_##node##_##field(l->field.avl_right, m, r);                     \
+      l->field.avl_right->field.parent= l;                                                              \
+         INT_SET_MAX_HIGH_##node##_##field(l);                                                          \
+      return INT_TREE_BALANCE_##node##_##field(l);                                                      \
+    }                                                                                                   \
+    if (hr > hl + TREE_DELTA_MAX) {                                                                     \
+      r->field.avl_left= INT_TREE_JOIN_##node##_##field(l, m, r->field.avl_left);                       \
+      r->field.avl_left->field.parent= r;                                                               \
+         INT_SET_MAX_HIGH_##node##_##field(r);                                                          \
+      return INT_TREE_BALANCE_##node##_##field(r);                                                      \
+    }                                                                                                   \
+    m->field.avl_left= l;                                                                               \
+    m->field.avl_right= r;                                                                              \
+    if (l) {l->field.parent= m;}                                                                        \
+    if (r) {r->field.parent= m;}                                                                        \
+       INT_SET_MAX_HIGH_##node##_##field(m);                                                            \
+    return INT_TREE_BALANCE_##node##_##field(m);                                                        \
+  }                                                                                                     \
+                                                                                                        \
+ /* splits self into *left, the nodes ordering before key (or not after it, when le is set), */         \
+ /* and *right, the rest.  each level costs one join and the joins telescope, so a split    */          \
+ /* costs O(log n) in all                                                                    */         \
+                                                                                                        \
+void INT_TREE_SPLIT_##node##_##field                                                                    \
+    (struct node *self, struct node *key, int le, int (*compare)(struct node *lhs, struct node *rhs),   \
+     struct node **left, struct node **right)                                                           \
+  {                                                                                                     \
+    struct node *l;                                                                                     \
+    struct node *r;                                                                                     \
+    int c;                                                                                              \
+                                                                                                        \
+    if (!self) {                                                                                        \
+      *left= 0;                                                                                         \
+      *right= 0;                                                                                        \
+      return;                                                                                           \
+    }                                                                                                   \
+    l= self->field.avl_left;                                                                            \
+    r= self->field.avl_right;                                                                           \
+    c= compare(self, key);                                                                              \
+    if ((c < 0) || (le && (c == 0))) {                                                                  \
+      INT_TREE_SPLIT_##node##_##field(r, key, le, compare, left, right);                                \
+      *left= INT_TREE_JOIN_##node##_##field(l, self, *left);                                            \
+    }                                                                                                   \
+    else {                                                                                              \
+      INT_TREE_SPLIT_##node##_##field(l, key, le, compare, left, right);                                \
+      *right= INT_TREE_JOIN_##node##_##field(*right, self, r);                                          \
+    }                                                                                                   \
+    if (*left)  {(*left)->field.parent= 0;}                                                             \
+    if (*right) {(*right)->field.parent= 0;}                                                            \
+  }                                                                                                     \
+                                                                                                        \
+ /* joins l and r, every node of l ordering before every node of r */                                   \
+                                                                                                        \
+struct node *INT_TREE_CONCAT_##node##_##field(struct node *l, struct node *r)                           \
+  {                                                                                                     \
+    struct node *m;                                                                                     \
+                                                                                                        \
+    if (!l) {                                                                                           \
+      return r;                                                                                         \
+    }                                                                                                   \
+    if (!r) {                                                                                           \
+      return l;                                                                                         \
+    }                                                                                                   \
+    m= INT_TREE_FIRST_##node##_##field(r);                                                              \
+    r= INT_TREE_REMOVE_NODE_##node##_##field(r, m);                                                     \
+    m= INT_TREE_JOIN_##node##_##field(l, m, r);                                                         \
+    m->field.parent= 0;                                                                                 \
+    return m;                                                                                           \
+  }                                                                                                     \
+                                                                                                        \
+ /* threads the nodes from self downward, in order, onto *tail through field.avl_right */               \
+                                                                                                        \
+void INT_TREE_FLATTEN_##node##_##field(struct node *self, struct node ***tail)                          \
+  {                                                                                                     \
+    struct node *r;                                                                                     \
+                                                                                                        \
+    if (!self) {                                                                                        \
+      return;                                                                                           \
+    }                                                                                                   \
+    r= self->field.avl_right;                                                                           \
+    INT_TREE_FLATTEN_##node##_##field(self->field.avl_left, tail);                                      \
+    self->field.avl_left= 0;                                                                            \
+    self->field.avl_right= 0;                                                                           \
+    self->field.parent= 0;                                                                              \
+    **tail= self;                                                                                       \
+    *tail= &self->field.avl_right;                                                                      \
+    INT_TREE_FLATTEN_##node##_##field(r, tail);                                                         \
+  }                                                                                                     \
+                                                                                                        \
+ /* removes the key range [lo, hi] under compare: split off the nodes before lo, then those   */        \
+ /* after hi, and join the two.  O(log n) for the splits and the join, O(k) for the list      */        \
+                                                                                                        \
+struct node *INT_TREE_REMOVE_RANGE_##node##_##field                                                     \
+    (struct node *self, struct node *lo, struct node *hi,                                               \
+     int (*compare)(struct node *lhs, struct node *rhs), struct node **removed)                         \
+  {                                                                                                     \
+    struct node *l;                                                                                     \
+    struct node *m;                                                                                     \
+    struct node *r;                                                                                     \
+                                                                                                        \
+    INT_TREE_SPLIT_##node##_##field(self, lo, 0, compare, &l, &m);                                      \
+    INT_TREE_SPLIT_##node##_##field(m, hi, 1, compare, &m, &r);                                         \
+    INT_TREE_FLATTEN_##node##_##field(m, &removed);                                                     \
+    *removed= 0;                                                                                        \
+    return INT_TREE_CONCAT_##node##_##field(l, r);                                                      \
+  }
+
+#define TREE_INSERT(head, node, field, elm)						                \
+  ((head)->th_root= TREE_INSERT_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
+
+#define INT_TREE_INSERT(head, node, field, elm)						                \
+  ((head)->th_root= INT_TREE_INSERT_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
+
+#define TREE_FIND(head, node, field, elm)				                                \
+  (TREE_FIND_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
+
+#define INT_INTERSECT(head, node, field, elm)				                                \
+  (INT_INTERSECT_##node##_##field((head)->th_root, (elm)))
+
+#define BOOL_INT_INTERSECT(head, node, field, elm)				                        \
+  (BOOL_INT_INTERSECT_##node##_##field((head)->th_root, (elm)))
+
+#define INT_MAX__INTERSECT(head, node, field, elm)				                        \
+  (INT_MAX_INTERSECT_##node##_##field((head)->th_root, (elm)))
+
+#define INT_MAX__CONTAINMENT(head, node, field, elm)				                        \
+  (INT_MAX_CONTAINMENT_##node##_##field((head)->th_root, (elm)))
+
+#define INT_TOPK__INTERSECT(head, node, field, elm, nodes, scores, k)                                   \
+  (INT_TOPK_INTERSECT_##node##_##field((head)->th_root, (elm), (nodes), (scores), (k)))
+
+#define TREE_REMOVE(head, node, field, elm)						                \
+  ((head)->th_root= TREE_REMOVE_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
+#define INT_TREE_REMOVE(head, node, field, elm)						                \
+  ((head)->th_root= INT_TREE_REMOVE_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
+
+#define INT_TREE_FIRST(head, node, field)                                                               \
+  (INT_TREE_FIRST_##node##_##field((head)->th_root))
+
+#define INT_TREE_LAST(head, node, field)                                                                \
+  (INT_TREE_LAST_##node##_##field((head)->th_root))
+
+#define INT_TREE_NEXT(node, field, elm)                                                                 \
+  (INT_TREE_NEXT_##node##_##field(elm))
+
+#define INT_TREE_PREV(node, field, elm)                                                                 \
+  (INT_TREE_PREV_##node##_##field(elm))
+
+#define INT_OVERLAP_FIRST(head, node, field, elm)                                                       \
+  (INT_OVERLAP_FIRST_##node##_##field((head)->th_root, (elm)))
+
+#define INT_OVERLAP_NEXT(node, field, cur, elm)                                                         \
+  (INT_OVERLAP_NEXT_##node##_##field((cur), (elm)))
+
+#define INT_OVERLAP_PAGE(node, field, cursor, elm, buf, max)                                            \
+  (INT_OVERLAP_PAGE_##node##_##field((cursor), (elm), (buf), (max)))
+
+#define INT_TREE_REMOVE_IF(head, node, field, pred, data, removed)                                      \
+  ((head)->th_root= INT_TREE_REMOVE_IF_##node##_##field((head)->th_root, (pred), (data), (removed)))
+
+#define INT_TREE_REMOVE_OVERLAPS(head, node, field, elm, removed)                                       \
+  ((head)->th_root= INT_TREE_REMOVE_OVERLAPS_##node##_##field((head)->th_root, (elm), (removed)))
+
+#define INT_TREE_REMOVE_RANGE(head, node, field, lo, hi, removed)                                       \
+  ((head)->th_root= INT_TREE_REMOVE_RANGE_##node##_##field((head)->th_root, (lo), (hi), (head)->th_cmp, \
+							    (removed)))
+
+#define TREE_DEPTH(head, field)			                                                        \
+  ((head)->th_root->field.avl_height)
+
+#define TREE_FORWARD_APPLY(head, node, field, function, data)	                                        \
+  TREE_FORWARD_APPLY_ALL_##node##_##field((head)->th_root, function, data)
+
+#define TREE_REVERSE_APPLY(head, node, field, function, data)	                                        \
+  TREE_REVERSE_APPLY_ALL_##node##_##field((head)->th_root, function, data)
+
+#define TREE_INIT(head, cmp) do {		                                                        \
+    (head)->th_root= 0;				                                                        \
+    (head)->th_cmp= (cmp);			                                                        \
+  } while (0)
+
+/* Parallel batch queries.
+ *
+ * The query functions (INT_INTERSECT, BOOL_INT_INTERSECT, INT_MAX_INTERSECT, INT_MAX_CONTAINMENT
+ * and the _ALL_ variants) only read the tree, keep no static state and produce no output of their
+ * own, so any number of threads may run them against the same tree at once provided nothing is
+ * inserting or removing meanwhile.  The _ALL_ variants report each hit through their callback,
+ * which is then responsible for its own reentrancy.
+ *
+ * TREE_DEFINE_PARALLEL(node, field) adds INT_PARALLEL_QUERY, which runs one such query for every
+ * element of an array of query nodes and writes the i-th answer to results[i].  The array is cut
+ * into equal contiguous ranges, one per thread.  A thread works through its own range from the
+ * front, INT_PARALLEL_GRAIN queries at a time, and when it runs dry steals the back half of the
+ * fullest range it can find.  Each thread writes only the result slots of the queries it claimed,
+ * so gathering the results needs no locking.  The calling thread takes part as worker 0, and no
+ * more threads are started than there are INT_PARALLEL_GRAIN-sized pieces of work.
+ *
+ * This part requires <pthread.h>.
+ */
+
+#define INT_PARALLEL_MAX_THREADS	64
+#define INT_PARALLEL_GRAIN		64
+
+#define TREE_DEFINE_PARALLEL(node, field)                                                               \
+                                                                                                        \
+struct INT_PARALLEL_JOB_##node##_##field;                                                               \
+                                                                                                        \
+struct INT_PARALLEL_RANGE_##node##_##field {                                                            \
+  pthread_mutex_t lock;                                                                                 \
+  size_t next;                                                                                          \
+  size_t end;                                                                                           \
+  struct INT_PARALLEL_JOB_##node##_##field *job;                                                        \
+  int id;                                                                                               \
+};                                                                                                      \
+                                                                                                        \
+struct INT_PARALLEL_JOB_##node##_##field {                                                              \
+  struct node *root;                                                                                    \
+  struct node **queries;                                                                                \
+  unsigned long long *results;                                                                          \
+  unsigned long long (*query)(struct node *self, struct node *elm);                                     \
+  int nthreads;                                                                                         \
+  struct INT_PARALLEL_RANGE_##node##_##field range[INT_PARALLEL_MAX_THREADS];                           \
+};                                                                                                      \
+                                                                                                        \
+ /* moves the back half of the fullest other range into r.  returns 0 once all work is claimed */       \
+                                                                                                        \
+int INT_PARALLEL_STEAL_##node##_##field(struct INT_PARALLEL_RANGE_##node##_##field *r)                  \
+  {                                                                                                     \
+    struct INT_PARALLEL_JOB_##node##_##field *job= r->job;                                              \
+    struct INT_PARALLEL_RANGE_##node##_##field *v;                                                      \
+    size_t best, left, mid, end;                                                                        \
+    int i, victim;                                                                                      \
+                                                                                                        \
+    for (;;) {                                                                                          \
+      victim= -1;                                                                                       \
+      best= 0;                                                                                          \
+      for (i= 0; i < job->nthreads; i++) {                                                              \
+        v= &job->range[(r->id + 1 + i) % job->nthreads];                                                \
+        if (v == r) continue;                                                                           \
+        pthread_mutex_lock(&v->lock);                                                                   \
+        left= v->end - v->next;                                                                         \
+        pthread_mutex_unlock(&v->lock);                                                                 \
+        if (left > best) {best= left; victim= (r->id + 1 + i) % job->nthreads;}                         \
+      }                                                                                                 \
+      if (victim < 0)                                                                                   \
+        return 0;                                                                                       \
+      v= &job->range[victim];                                                                           \
+      pthread_mutex_lock(&v->lock);                                                                     \
+      if (v->next < v->end) {                                                                           \
+        mid= v->next + (v->end - v->next) / 2;                                                          \
+        end= v->end;                                                                                    \
+        v->end= mid;                                                                                    \
+        pthread_mutex_unlock(&v->lock);                                                                 \
+        pthread_mutex_lock(&r->lock);                                                                   \
+        r->next= mid;                                                                                   \
+        r->end= end;                                                                                    \
+        pthread_mutex_unlock(&r->lock);                                                                 \
+        return 1;                                                                                       \
+      }                                                                                                 \
+      pthread_mutex_unlock(&v->lock);                                                                   \
+    }                                                                                                   \
+  }                                                                                                     \
+                                                                                                        \
+void *INT_PARALLEL_WORKER_##node##_##field(void *arg)                                                   \
+  {                                                                                                     \
+    struct INT_PARALLEL_RANGE_##node##_##field *r= (struct INT_PARALLEL_RANGE_##node##_##field *)arg;   \
+    struct INT_PARALLEL_JOB_##node##_##field *job= r->job;                                              \
+    size_t b, e;                                                                                        \
+                                                                                                        \
+    for (;;) {                                                                                          \
+      pthread_mutex_lock(&r->lock);                                                                     \
+      b= r->next;                                                                                       \
+      e= b + INT_PARALLEL_GRAIN;                                                                        \
+      if (e > r->end) e= r->end;                                                                        \
+      r->next= e;                                                                                       \
+      pthread_mutex_unlock(&r->lock);                                                                   \
+      if (b == e) {                                                                                     \
+        if (!INT_PARALLEL_STEAL_##node##_##field(r))                                                    \
+          return 0;                                                                                     \
+        continue;                                                                                       \
+      }                                                                                                 \
+      for (; b < e; b++)                                                                                \
+        job->results[b]= job->query(job->root, job->queries[b]);                                        \
+    }                                                                                                   \
+  }                                                                                                     \
+                                                                                                        \
+ /* returns the number of threads that took part.  a thread that cannot be created simply leaves */     \
+ /* its range to be stolen by the others                                                          */    \
+                                                                                                        \
+int INT_PARALLEL_QUERY_##node##_##field                                                                 \
+  (struct node *self, unsigned long long (*query)(struct node *self, struct node *elm),                 \
+   struct node **queries, unsigned long long *results, size_t n, int nthreads)                          \
+  {                                                                                                     \
+    struct INT_PARALLEL_JOB_##node##_##field job;                                                       \
+    pthread_t tid[INT_PARALLEL_MAX_THREADS];                                                            \
+    int started[INT_PARALLEL_MAX_THREADS];                                                              \
+    int i, used;                                                                                        \
+                                                                                                        \
+    if (nthreads < 1) nthreads= 1;                                                                      \
+    if (nthreads > INT_PARALLEL_MAX_THREADS) nthreads= INT_PARALLEL_MAX_THREADS;                        \
+    if ((size_t)nthreads > (n + INT_PARALLEL_GRAIN - 1) / INT_PARALLEL_GRAIN)                           \
+      nthreads= n ? (int)((n + INT_PARALLEL_GRAIN - 1) / INT_PARALLEL_GRAIN) : 1;                       \
+                                                                                                        \
+    job.root= self;                                                                                     \
+    job.queries= queries;                                                                               \
+    job.results= results;                                                                               \
+    job.query= query;                                                                                   \
+    job.nthreads= nthreads;                                                                             \
+    for (i= 0; i < nthreads; i++) {                                                                     \
+      pthread_mutex_init(&job.range[i].lock, 0);                                                        \
+      job.range[i].next= n * i / nthreads;                                                              \
+      job.range[i].end= n * (i + 1) / nthreads;                                                         \
+      job.range[i].job= &job;                                                                           \
+      job.range[i].id= i;                                                                               \
+    }                                                                                                   \
+    used= 1;                                                                                            \
+    for (i= 1; i < nthreads; i++) {                                                                     \
+      started[i]= !pthread_create(&tid[i], 0, INT_PARALLEL_WORKER_##node##_##field, &job.range[i]);     \
+      used += started[i];                                                                               \
+    }                                                                                                   \
+    INT_PARALLEL_WORKER_##node##_##field(&job.range[0]);                                                \
+    for (i= 1; i < nthreads; i++) {                                                                     \
+      if (started[i]) pthread_join(tid[i], 0);                                                          \
+    }                                                                                                   \
+    for (i= 0; i < nthreads; i++)                                                                       \
+      pthread_mutex_destroy(&job.range[i].lock);                                                        \
+    return used;                                                                                        \
+  }
+
+#define INT_PARALLEL_QUERY(head, node, field, query, queries, results, n, nthreads)                     \
+  (INT_PARALLEL_QUERY_##node##_##field((head)->th_root, (query), (queries), (results), (n), (nthreads)))
+
+#define INT_PARALLEL_MAX_INTERSECT(head, node, field, queries, results, n, nthreads)                    \
+  INT_PARALLEL_QUERY(head, node, field, INT_MAX_INTERSECT_##node##_##field,                             \
+		     queries, results, n, nthreads)
+
+#define INT_PARALLEL_MAX_CONTAINMENT(head, node, field, queries, results, n, nthreads)                  \
+  INT_PARALLEL_QUERY(head, node, field, INT_MAX_CONTAINMENT_##node##_##field,                           \
+		     queries, results, n, nthreads)
+
+/* Multiplicity-compressed interval trees.
+ *
+ * When many records share an identical [low, high] it is wasteful to give each its own AVL node:
+ * the tree grows taller and every INT_FIX_MAX_HIGH walk grows with it.  TREE_DEFINE_DUP(node,
+ * field, dup) layers a duplicate list over an interval tree made by TREE_DEFINE(node, field).
+ * The first record with a given interval becomes the structural node; the rest hang off it in a
+ * singly-linked list threaded through the TREE_DUP_ENTRY, and never enter the tree.  The size of
+ * the tree therefore tracks the number of distinct intervals rather than the number of records.
+ *
+ * compare must order by low and then by high, so that two nodes compare equal exactly when their
+ * intervals are identical.  dup_count is kept on the structural node and counts every record in
+ * its list, itself included.  Removing the structural node promotes the next record in its list
+ * into its place in the tree, which costs one descent and no rebalancing.
+ *
+ * A tree carrying duplicate lists must only be changed through INT_TREE_INSERT_DUP and
+ * INT_TREE_REMOVE_DUP.  INT_TREE_REMOVE and the bulk removals (INT_TREE_REMOVE_IF, _RANGE and
+ * _OVERLAPS) know nothing of the lists: they take out the structural node alone and leave the
+ * rest of its list unreachable.
+ */
+
+#define TREE_DUP_ENTRY(type)			\
+  struct {					\
+    struct type	*dup_next;			\
+    unsigned int dup_count;			\
+  }
+
+#define TREE_DEFINE_DUP(node, field, dup)                                                               \
+                                                                                                        \
+ /* returns the structural node holding elm's interval, or 0 */                                         \
+                                                                                                        \
+struct node *INT_TREE_FIND_DUP_##node##_##field                                                         \
+  (struct node *self, struct node *elm, int (*compare)(struct node *lhs, struct node *rhs))             \
+  {                                                                                                     \
+    struct node *s= TREE_FIND_##node##_##field(self, elm, compare);                                     \
+                                                                                                        \
+    if (s && (s->low == elm->low) && (s->high == elm->high)) {                                          \
+      return s;                                                                                         \
+    }                                                                                                   \
+    return 0;                                                                                           \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT_TREE_INSERT_DUP_##node##_##field                                                       \
+  (struct node *self, struct node *elm, int (*compare)(struct node *lhs, struct node *rhs))             \
+  {                                                                                                     \
+    struct node *s= INT_TREE_FIND_DUP_##node##_##field(self, elm, compare);                             \
+                                                                                                        \
+    if (s) {                                                                                            \
+      elm->dup.dup_next= s->dup.dup_next;                                                               \
+      elm->dup.dup_count= 0;                                                                            \
+      s->dup.dup_next= elm;                                                                             \
+      s->dup.dup_count += 1;                                                                            \
+      return self;                                                                                      \
+    }                                                                                                   \
+    elm->dup.dup_next= 0;                                                                               \
+    elm->dup.dup_count= 1;                                                                              \
+    return INT_TREE_INSERT_##node##_##field(self, elm, compare);                                        \
+  }                                                                                                     \
+                                                                                                        \
+ /* puts rep in old's place in the tree; rep inherits old's links, height and max_high */               \
+                                                                                                        \
+struct node *INT_TREE_REPLACE_DUP_##node##_##field                                                      \
+  (struct node *self, struct node *old, struct node *rep,                                               \
+   int (*compare)(struct node *lhs, struct node *rhs))                                                  \
+  {                                                                                                     \
+    if (!self) return 0;                                                                                \
+                                                                                                        \
+    if (self == old) {                                                                                  \
+      rep->field= old->field;                                                                           \
+      rep->max_high= old->max_high;                                                                     \
+      if (rep->field.avl_left)  {rep->field.avl_left->field.parent= rep;}                               \
+      if (rep->field.avl_right) {rep->field.avl_right->field.parent= rep;}                              \
+      old->field.avl_left= 0;                                                                           \
+      old->field.avl_right= 0;                                                                          \
+      old->field.parent= 0;                                                                             \
+      return rep;                                                                                       \
+    }                                                                                                   \
+    if (compare(old, self) < 0)                                                                         \
+      self->field.avl_left= INT_TREE_REPLACE_DUP_##node##_##field(self->field.avl_left,                 \
+                                                                  old, rep, compare);                   \
+    else                                                                                                \
+      self->field.avl_right= INT_TREE_REPLACE_DUP_##node##_##field(self->field.avl_right,               \
+                                                                   old, rep, compare);                  \
+    return self;                                                                                        \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT_TREE_REMOVE_DUP_##node##_##field                                                       \
+  (struct node *self, struct node *elm, int (*compare)(struct node *lhs, struct node *rhs))             \
+  {                                                                                                     \
+    struct node *s= INT_TREE_FIND_DUP_##node##_##field(self, elm, compare);                             \
+    struct node *p;                                                                                     \
+    struct node *d;                                                                                     \
+                                                                                                        \
+    if (!s) {                                                                                           \
+      return self;                                                                                      \
+    }                                                                                                   \
+    if (s != elm) {                                                                                     \
+      for (p= s; p->dup.dup_next && (p->dup.dup_next != elm); p= p->dup.dup_next)                       \
+        ;                                                                                               \
+      if (p->dup.dup_next) {                                                                            \
+        p->dup.dup_next= elm->dup.dup_next;                                                             \
+        s->dup.dup_count -= 1;                                                                          \
+        elm->dup.dup_next= 0;                                                                           \
+      }                                                                                                 \
+      return self;                                                                                      \
+    }                                                                                                   \
+    if (!(d= s->dup.dup_next)) {                                                                        \
+      s->dup.dup_count= 0;                                                                              \
+      return INT_TREE_REMOVE_##node##_##field(self, elm, compare);                                      \
+    }                                                                                                   \
+    d->dup.dup_count= s->dup.dup_count - 1;                                                             \
+    s->dup.dup_next= 0;                                                                                 \
+    s->dup.dup_count= 0;                                                                                \
+    return INT_TREE_REPLACE_DUP_##node##_##field(self, s, d, compare);                                  \
+  }                                                                                                     \
+                                                                                                        \
+ /* applies function to the structural node self and every duplicate record hanging off it */           \
+                                                                                                        \
+void INT_DUP_APPLY_##node##_##field                                                                     \
+  (struct node *self, void (*function)(struct node *node, void *data), void *data)                      \
+  {                                                                                                     \
+    struct node *n;                                                                                     \
+    struct node *t;                                                                                     \
+                                                                                                        \
+    for (n= self; n; n= t) {                                                                            \
+      t= n->dup.dup_next;                                                                               \
+      function(n, data);                                                                                \
+    }                                                                                                   \
+  }                                                                                                     \
+                                                                                                        \
+ /* applies function to every record, duplicates included, whose interval intersects elm */             \
+                                                                                                        \
+void INT_DUP_OVERLAP_APPLY_##node##_##field                                                             \
+  (struct node *self, struct node *elm, void (*function)(struct node *node, void *data), void *data)    \
+  {                                                                                                     \
+    if (!self) {                                                                                        \
+      return;                                                                                           \
+    }                                                                                                   \
+    if (self->max_high < elm->low) {                                                                    \
+      return;                                                                                           \
+    }                                                                                                   \
+    INT_DUP_OVERLAP_APPLY_##node##_##field(self->field.avl_left, elm, function, data);                  \
+    if (self->low > elm->high) {                                                                        \
+      return;                                                                                           \
+    }                                                                                                   \
+    if (elm->low <= self->high) {                                                                       \
+      INT_DUP_APPLY_##node##_##field(self, function, data);                                             \
+    }                                                                                                   \
+    INT_DUP_OVERLAP_APPLY_##node##_##field(self->field.avl_right, elm, function, data);                 \
+  }
+
+#define INT_TREE_INSERT_DUP(head, node, field, elm)                                                     \
+  ((head)->th_root= INT_TREE_INSERT_DUP_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
+
+#define INT_TREE_REMOVE_DUP(head, node, field, elm)                                                     \
+  ((head)->th_root= INT_TREE_REMOVE_DUP_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
+
+#define INT_TREE_FIND_DUP(head, node, field, elm)                                                       \
+  (INT_TREE_FIND_DUP_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
+
+#define INT_DUP_COUNT(elm, dup)                                                                         \
+  ((elm)->dup.dup_count)
+
+#define INT_DUP_OVERLAP_APPLY(head, node, field, elm, function, data)                                   \
+  INT_DUP_OVERLAP_APPLY_##node##_##field((head)->th_root, (elm), function, data)
+
+/* Persistent (versioned) interval trees.
+ *
+ * A persistent tree never modifies a node that is reachable from more than one version.  Updates
+ * copy the path from the root down to the changed node (O(log n) new nodes per update) and share
+ * every untouched subtree with the older versions.  Nodes are reference counted: each parent link
+ * and each root held by the caller counts as one reference.  A node whose count is 1 belongs to a
+ * single version only and is updated in place, so a tree with no outstanding snapshots costs no
+ * more than an ordinary one.
+ *
+ * There is no parent pointer in a persistent node (a shared node has many parents), which is why
+ * PTREE_ENTRY is distinct from TREE_ENTRY.  max_high is recomputed bottom-up from the children as
+ * the path is rebuilt, so every version carries its own max_high.
+ *
+ * The head carries two callbacks besides the comparison function:
+ *
+ *   clone(n)    returns a shallow copy of n (payload, low, high, max_high and links);
+ *   release(n)  is called once the last version referring to n has been released.
+ *
+ * PTREE_INSERT and PTREE_REMOVE replace the head's current version.  Take a PTREE_SNAPSHOT first
+ * to keep the old one around, and hand it back with PTREE_RELEASE when done with it.  A removed
+ * node must not be inserted again until release() has been called on it.
+ */
+
+#define PTREE_ENTRY(type)			\
+  struct {					\
+    struct type	*avl_left;			\
+    struct type	*avl_right;			\
+    int		 avl_height;			\
+    int		 refs;				\
+  }
+
+#define PTREE_HEAD(name, type)                                                                          \
+  struct name {                                                                                         \
+    struct type *th_root;                                                                               \
+    int  (*th_cmp)(struct type *lhs, struct type *rhs);                                                 \
+    struct type *(*th_clone)(struct type *self);                                                        \
+    void (*th_release)(struct type *self);                                                              \
+  }
+
+#define PTREE_INITIALIZER(cmp, clone, release) { 0, cmp, clone, release }
+
+#define PTREE_DEFINE(node, field)                                                                       \
+                                                                                                        \
+struct node *PTREE_RETAIN_##node##_##field(struct node *self)                                           \
+  {                                                                                                     \
+    if (self)                                                                                           \
+      self->field.refs += 1;                                                                            \
+    return self;                                                                                        \
+  }                                                                                                     \
+                                                                                                        \
+void PTREE_RELEASE_##node##_##field(struct node *self, void (*release)(struct node *self))              \
+  {                                                                                                     \
+    if (!self)                                                                                          \
+      return;                                                                                           \
+    if (--self->field.refs > 0)                                                                         \
+      return;                                                                                           \
+    PTREE_RELEASE_##node##_##field(self->field.avl_left, release);                                      \
+    PTREE_RELEASE_##node##_##field(self->field.avl_right, release);                                     \
+    release(self);                                                                                      \
+  }                                                                                                     \
+                                                                                                        \
+ /* recompute height and max_high of self from its children */                                          \
+                                                                                                        \
+struct node *PTREE_UPDATE_##node##_##field(struct node *self)                                           \
+  {                                                                                                     \
+    self->field.avl_height= 0;                                                                          \
+    self->max_high= self->high;                                                                         \
+    if (self->field.avl_left) {                                                                         \
+      self->field.avl_height= self->field.avl_left->field.avl_height;                                   \
+      if (self->field.avl_left->max_high > self->max_high)                                              \
+        self->max_high= self->field.avl_left->max_high;                                                 \
+    }                                                                                                   \
+    if (self->field.avl_right) {                                                                        \
+      if (self->field.avl_right->field.avl_height > self->field.avl_height)                             \
+        self->field.avl_height= self->field.avl_right->field.avl_height;                                \
+      if (self->field.avl_right->max_high > self->max_high)                                             \
+        self->max_high= self->field.avl_right->max_high;                                                \
+    }                                                                                                   \
+    self->field.avl_height += 1;                                                                        \
+    return self;                                                                                        \
+  }                                                                                                     \
+                                                                                                        \
+ /* the caller owns one reference to self.  if that is the only one, self may be modified in */         \
+ /* place; otherwise the reference is traded for a private copy which shares self's children */         \
+                                                                                                        \
+struct node *PTREE_MUTABLE_##node##_##field                                                             \
+  (struct node *self, struct node *(*clone)(struct node *self))                                         \
+  {                                                                                                     \
+    struct node *copy;                                                                                  \
+                                                                                                        \
+    if (self->field.refs == 1)                                                                          \
+      return self;                                                                                      \
+    copy= clone(self);                                                                                  \
+    copy->field.refs= 1;                                                                                \
+    PTREE_RETAIN_##node##_##field(copy->field.avl_left);                                                \
+    PTREE_RETAIN_##node##_##field(copy->field.avl_right);                                               \
+    self->field.refs -= 1;                                                                              \
+    return copy;                                                                                        \
+  }                                                                                                     \
+                                                                                                        \
+struct node *PTREE_BALANCE_##node##_##field(struct node *, struct node *(*)(struct node *));            \
+                                                                                                        \
+ /* rotations are only ever applied to nodes (and the child moving up) that are already private */      \
+                                                                                                        \
+struct node *PTREE_ROTL_##node##_##field                                                                \
+  (struct node *self, struct node *(*clone)(struct node *self))                                         \
+  {                                                                                                     \
+    struct node *r= self->field.avl_right;                                                              \
+    self->field.avl_right= r->field.avl_left;                                                           \
+    r->field.avl_left= PTREE_BALANCE_##node##_##field(self, clone);                                     \
+    return PTREE_BALANCE_##node##_##field(r, clone);                                                    \
+  }                                                                                                     \
+                                                                                                        \
+struct node *PTREE_ROTR_##node##_##field                                                                \
+  (struct node *self, struct node *(*clone)(struct node *self))                                         \
+  {                                                                                                     \
+    struct node *l= self->field.avl_left;                                                               \
+    self->field.avl_left= l->field.avl_right;                                                           \
+    l->field.avl_right= PTREE_BALANCE_##node##_##field(self, clone);                                    \
+    return PTREE_BALANCE_##node##_##field(l, clone);                                                    \
+  }                                                                                                     \
+                                                                                                        \
+struct node *PTREE_BALANCE_##node##_##field                                                             \
+  (struct node *self, struct node *(*clone)(struct node *self))                                         \
+  {                                                                                                     \
+    struct node *c;                                                                                     \
+    int delta= TREE_DELTA(self, field);                                                                 \
+                                                                                                        \
+    if (delta < -TREE_DELTA_MAX)                                                                        \
+      {                                                                                                 \
+        c= PTREE_MUTABLE_##node##_##field(self->field.avl_right, clone);                                \
+        self->field.avl_right= c;                                                                       \
+        if (TREE_DELTA(c, field) > 0) {                                                                 \
+          c->field.avl_left= PTREE_MUTABLE_##node##_##field(c->field.avl_left, clone);                  \
+          self->field.avl_right= PTREE_ROTR_##node##_##field(c, clone);                                 \
+        }                                                                                               \
+        return PTREE_ROTL_##node##_##field(self, clone);                                                \
+      }                                                                                                 \
+    else if (delta > TREE_DELTA_MAX)                                                                    \
+      {                                                                                                 \
+        c= PTREE_MUTABLE_##node##_##field(self->field.avl_left, clone);                                 \
+        self->field.avl_left= c;                                                                        \
+        if (TREE_DELTA(c, field) < 0) {                                                                 \
+          c->field.avl_right= PTREE_MUTABLE_##node##_##field(c->field.avl_right, clone);                \
+          self->field.avl_left= PTREE_ROTL_##node##_##field(c, clone);                                  \
+        }                                                                                               \
+        return PTREE_ROTR_##node##_##field(self, clone);                                                \
+      }                                                                                                 \
+    return PTREE_UPDATE_##node##_##field(self);                                                         \
+  }                                                                                                     \
+                                                                                                        \
+ /* consumes the caller's reference to self and returns the (owned) root of the new version */          \
+                                                                                                        \
+struct node *PTREE_INSERT_##node##_##field                                                              \
+  (struct node *self, struct node *elm, int (*compare)(struct node *lhs, struct node *rhs),             \
+   struct node *(*clone)(struct node *self))                                                            \
+  {                                                                                                     \
+    if (!self) {                                                                                        \
+      elm->field.avl_left= 0;                                                                           \
+      elm->field.avl_right= 0;                                                                          \
+      elm->field.refs= 1;                                                                               \
+      return PTREE_UPDATE_##node##_##field(elm);                                                        \
+    }                                                                                                   \
+    self= PTREE_MUTABLE_##node##_##field(self, clone);                                                  \
+    if (compare(elm, self) < 0)                                                                         \
+      self->field.avl_left= PTREE_INSERT_##node##_##field(self->field.avl_left, elm, compare, clone);   \
+    else                                                                                                \
+      self->field.avl_right= PTREE_INSERT_##node##_##field(self->field.avl_right, elm, compare, clone); \
+    return PTREE_BALANCE_##node##_##field(self, clone);                                                 \
+  }                                                                                                     \
+                                                                                                        \
+struct node *PTREE_MOVE_RIGHT_##node##_##field                                                          \
+  (struct node *self, struct node *rhs, struct node *(*clone)(struct node *self))                       \
+  {                                                                                                     \
+    if (!self)                                                                                          \
+      return rhs;                                                                                       \
+    self= PTREE_MUTABLE_##node##_##field(self, clone);                                                  \
+    self->field.avl_right= PTREE_MOVE_RIGHT_##node##_##field(self->field.avl_right, rhs, clone);        \
+    return PTREE_BALANCE_##node##_##field(self, clone);                                                 \
+  }                                                                                                     \
+                                                                                                        \
+ /* consumes the caller's reference to self.  the removed node stays alive for as long as an */         \
+ /* older version still refers to it; release() is called on it once none does.  a removed   */         \
+ /* node held by this version alone hands its children over rather than sharing them, so     */         \
+ /* they stay private and are not copied on the way back up                                  */         \
+                                                                                                        \
+struct node *PTREE_REMOVE_##node##_##field                                                              \
+  (struct node *self, struct node *elm, int (*compare)(struct node *lhs, struct node *rhs),             \
+   struct node *(*clone)(struct node *self), void (*release)(struct node *self))                        \
+  {                                                                                                     \
+    struct node *l, *r, *tmp;                                                                           \
+                                                                                                        \
+    if (!self) return 0;                                                                                \
+                                                                                                        \
+    if (compare(elm, self) == 0)                                                                        \
+      {                                                                                                 \
+        l= self->field.avl_left;                                                                        \
+        r= self->field.avl_right;                                                                       \
+        if (self->field.refs == 1) {                                                                    \
+          self->field.avl_left= 0;                                                                      \
+          self->field.avl_right= 0;                                                                     \
+        }                                                                                               \
+        else {                                                                                          \
+          PTREE_RETAIN_##node##_##field(l);                                                             \
+          PTREE_RETAIN_##node##_##field(r);                                                             \
+        }                                                                                               \
+        tmp= PTREE_MOVE_RIGHT_##node##_##field(l, r, clone);                                            \
+        PTREE_RELEASE_##node##_##field(self, release);                                                  \
+        return tmp;                                                                                     \
+      }                                                                                                 \
+    self= PTREE_MUTABLE_##node##_##field(self, clone);                                                  \
+    if (compare(elm, self) < 0)                                                                         \
+      self->field.avl_left= PTREE_REMOVE_##node##_##field(self->field.avl_left, elm, compare,           \
+                                                          clone, release);                              \
+    else                                                                                                \
+      self->field.avl_right= PTREE_REMOVE_##node##_##field(self->field.avl_right, elm, compare,         \
+                                                           clone, release);                             \
+    return PTREE_BALANCE_##node##_##field(self, clone);                                                 \
+  }                                                                                                     \
+                                                                                                        \
+ /* applies function, in order, to every node in the version rooted at self that intersects elm */      \
+                                                                                                        \
+void PTREE_OVERLAP_APPLY_##node##_##field                                                               \
+  (struct node *self, struct node *elm, void (*function)(struct node *node, void *data), void *data)    \
+  {                                                                                                     \
+    if (!self) {                                                                                        \
+      return;                                                                                           \
+    }                                                                                                   \
+    if (self->max_high < elm->low) {                                                                    \
+      return;                                                                                           \
+    }                                                                                                   \
+    PTREE_OVERLAP_APPLY_##node##_##field(self->field.avl_left, elm, function, data);                    \
+    if (self->low > elm->high) {                                                                        \
+      return;                                                                                           \
+    }                                                                                                   \
+    if (elm->low <= self->high) {                                                                       \
+      function(self, data);                                                                             \
+    }                                                                                                   \
+    PTREE_OVERLAP_APPLY_##node##_##field(self->field.avl_right, elm, function, data);                   \
+  }
+
+#define PTREE_INSERT(head, node, field, elm)                                                            \
+  ((head)->th_root= PTREE_INSERT_##node##_##field((head)->th_root, (elm), (head)->th_cmp,               \
+						  (head)->th_clone))
+
+#define PTREE_REMOVE(head, node, field, elm)                                                            \
+  ((head)->th_root= PTREE_REMOVE_##node##_##field((head)->th_root, (elm), (head)->th_cmp,               \
+						  (head)->th_clone, (head)->th_release))
+
+#define PTREE_SNAPSHOT(head, node, field)                                                               \
+  (PTREE_RETAIN_##node##_##field((head)->th_root))
+
+#define PTREE_RELEASE(head, node, field, root)                                                          \
+  (PTREE_RELEASE_##node##_##field((root), (head)->th_release))
+
+#define PTREE_OVERLAP_APPLY(root, node, field, elm, function, data)                                     \
+  PTREE_OVERLAP_APPLY_##node##_##field((root), (elm), function, data)
+
+/* Two-dimensional (rectangle) interval trees.
+ *
+ * Each node is a box [low, high] x [y_low, y_high].  The tree is an interval tree on the first
+ * axis, ordered by compare (which, as for the one-dimensional queries, must order by low), and
+ * every node is further augmented with the extent of its subtree on the second axis:
+ *
+ *   max_high    the largest high in the subtree (as in the one-dimensional tree);
+ *   y_min_low   the smallest y_low in the subtree;
+ *   y_max_high  the largest y_high in the subtree.
+ *
+ * All six fields are declared by the user alongside the TREE_ENTRY.  An overlap query skips any
+ * subtree whose box misses the query on either axis, so a selective second dimension prunes the
+ * search instead of being filtered afterwards.  The augmentation is recomputed from the children
+ * on the way back up from every update; the parent field of the entry is not used.
+ *
+ * INT2_TREE_BULK_LOAD builds a perfectly balanced tree from an array of nodes in O(n log n) time
+ * (a heapsort of the array followed by a linear build) without allocating.
+ */
+
+#define INT2_DEFINE(node, field)                                                                        \
+                                                                                                        \
+struct node *INT2_TREE_BALANCE_##node##_##field(struct node *);                                         \
+                                                                                                        \
+struct node *INT2_UPDATE_##node##_##field(struct node *self)                                            \
+  {                                                                                                     \
+    struct node *c;                                                                                     \
+                                                                                                        \
+    self->field.avl_height= 0;                                                                          \
+    self->max_high= self->high;                                                                         \
+    self->y_min_low= self->y_low;                                                                       \
+    self->y_max_high= self->y_high;                                                                     \
+    if ((c= self->field.avl_left)) {                                                                    \
+      self->field.avl_height= c->field.avl_height;                                                      \
+      if (c->max_high   > self->max_high)   {self->max_high   = c->max_high;}                           \
+      if (c->y_min_low  < self->y_min_low)  {self->y_min_low  = c->y_min_low;}                          \
+      if (c->y_max_high > self->y_max_high) {self->y_max_high = c->y_max_high;}                         \
+    }                                                                                                   \
+    if ((c= self->field.avl_right)) {                                                                   \
+      if (c->field.avl_height > self->field.avl_height)                                                 \
+        self->field.avl_height= c->field.avl_height;                                                    \
+      if (c->max_high   > self->max_high)   {self->max_high   = c->max_high;}                           \
+      if (c->y_min_low  < self->y_min_low)  {self->y_min_low  = c->y_min_low;}                          \
+      if (c->y_max_high > self->y_max_high) {self->y_max_high = c->y_max_high;}                         \
+    }                                                                                                   \
+    self->field.avl_height += 1;                                                                        \
+    return self;                                                                                        \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT2_TREE_ROTL_##node##_##field(struct node *self)                                         \
+  {                                                                                                     \
+    struct node *r= self->field.avl_right;                                                              \
+    self->field.avl_right= r->field.avl_left;                                                           \
+    r->field.avl_left= INT2_TREE_BALANCE_##node##_##field(self);                                        \
+    return INT2_TREE_BALANCE_##node##_##field(r);                                                       \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT2_TREE_ROTR_##node##_##field(struct node *self)                                         \
+  {                                                                                                     \
+    struct node *l= self->field.avl_left;                                                               \
+    self->field.avl_left= l->field.avl_right;                                                           \
+    l->field.avl_right= INT2_TREE_BALANCE_##node##_##field(self);                                       \
+    return INT2_TREE_BALANCE_##node##_##field(l);                                                       \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT2_TREE_BALANCE_##node##_##field(struct node *self)                                      \
+  {                                                                                                     \
+    int delta= TREE_DELTA(self, field);                                                                 \
+                                                                                                        \
+    if (delta < -TREE_DELTA_MAX)                                                                        \
+      {                                                                                                 \
+        if (TREE_DELTA(self->field.avl_right, field) > 0)                                               \
+          self->field.avl_right= INT2_TREE_ROTR_##node##_##field(self->field.avl_right);                \
+        return INT2_TREE_ROTL_##node##_##field(self);                                                   \
+      }                                                                                                 \
+    else if (delta > TREE_DELTA_MAX)                                                                    \
+      {                                                                                                 \
+        if (TREE_DELTA(self->field.avl_left, field) < 0)                                                \
+          self->field.avl_left= INT2_TREE_ROTL_##node##_##field(self->field.avl_left);                  \
+        return INT2_TREE_ROTR_##node##_##field(self);                                                   \
+      }                                                                                                 \
+    return INT2_UPDATE_##node##_##field(self);                                                          \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT2_TREE_INSERT_##node##_##field                                                          \
+  (struct node *self, struct node *elm, int (*compare)(struct node *lhs, struct node *rhs))             \
+  {                                                                                                     \
+    if (!self) {                                                                                        \
+      elm->field.avl_left= 0;                                                                           \
+      elm->field.avl_right= 0;                                                                          \
+      return INT2_UPDATE_##node##_##field(elm);                                                         \
+    }                                                                                                   \
+    if (compare(elm, self) < 0)                                                                         \
+      self->field.avl_left= INT2_TREE_INSERT_##node##_##field(self->field.avl_left, elm, compare);      \
+    else                                                                                                \
+      self->field.avl_right= INT2_TREE_INSERT_##node##_##field(self->field.avl_right, elm, compare);    \
+    return INT2_TREE_BALANCE_##node##_##field(self);                                                    \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT2_TREE_MOVE_RIGHT_##node##_##field(struct node *self, struct node *rhs)                 \
+  {                                                                                                     \
+    if (!self)                                                                                          \
+      return rhs;                                                                                       \
+    self->field.avl_right= INT2_TREE_MOVE_RIGHT_##node##_##field(self->field.avl_right, rhs);           \
+    return INT2_TREE_BALANCE_##node##_##field(self);                                                    \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT2_TREE_REMOVE_##node##_##field                                                          \
+  (struct node *self, struct node *elm, int (*compare)(struct node *lhs, struct node *rhs))             \
+  {                                                                                                     \
+    struct node *tmp;                                                                                   \
+                                                                                                        \
+    if (!self) return 0;                                                                                \
+                                                                                                        \
+    if (compare(elm, self) == 0)                                                                        \
+      {                                                                                                 \
+        tmp= INT2_TREE_MOVE_RIGHT_##node##_##field(self->field.avl_left, self->field.avl_right);        \
+        self->field.avl_left= 0;                                                                        \
+        self->field.avl_right= 0;                                                                       \
+        return tmp;                                                                                     \
+      }                                                                                                 \
+    if (compare(elm, self) < 0)                                                                         \
+      self->field.avl_left= INT2_TREE_REMOVE_##node##_##field(self->field.avl_left, elm, compare);      \
+    else                                                                                                \
+      self->field.avl_right= INT2_TREE_REMOVE_##node##_##field(self->field.avl_right, elm, compare);    \
+    return INT2_TREE_BALANCE_##node##_##field(self);                                                    \
+  }                                                                                                     \
+                                                                                                        \
+ /* applies function, in order, to every node from self downward whose box intersects elm's */          \
+                                                                                                        \
+void INT2_OVERLAP_APPLY_##node##_##field                                                                \
+  (struct node *self, struct node *elm, void (*function)(struct node *node, void *data), void *data)    \
+  {                                                                                                     \
+    if (!self) {                                                                                        \
+      return;                                                                                           \
+    }                                                                                                   \
+    if ((self->max_high < elm->low) ||                                                                  \
+        (self->y_max_high < elm->y_low) || (self->y_min_low > elm->y_high)) {                           \
+      return;                                                                                           \
+    }                                                                                                   \
+    INT2_OVERLAP_APPLY_##node##_##field(self->field.avl_left, elm, function, data);                     \
+    if (self->low > elm->high) {                                                                        \
+      return;                                                                                           \
+    }                                                                                                   \
+    if ((elm->low <= self->high) && (elm->y_low <= self->y_high) && (elm->y_high >= self->y_low)) {     \
+      function(self, data);                                                                             \
+    }                                                                                                   \
+    INT2_OVERLAP_APPLY_##node##_##field(self->field.avl_right, elm, function, data);                    \
+  }                                                                                                     \
+                                                                                                        \
+void INT2_SIFT_##node##_##field                                                                         \
+  (struct node **v, int i, int n, int (*compare)(struct node *lhs, struct node *rhs))                   \
+  {                                                                                                     \
+    struct node *t;                                                                                     \
+    int c;                                                                                              \
+                                                                                                        \
+    while ((c= 2*i + 1) < n) {                                                                          \
+      if ((c + 1 < n) && (compare(v[c], v[c + 1]) < 0))                                                 \
+        c++;                                                                                            \
+      if (compare(v[i], v[c]) >= 0)                                                                     \
+        break;                                                                                          \
+      t= v[i]; v[i]= v[c]; v[c]= t;                                                                     \
+      i= c;                                                                                             \
+    }                                                                                                   \
+  }                                                                                                     \
+                                                                                                        \
+struct node *INT2_TREE_BUILD_##node##_##field(struct node **v, int n)                                   \
+  {                                                                                                     \
+    struct node *self;                                                                                  \
+    int m;                                                                                              \
+                                                                                                        \
+    if (n <= 0)                                                                                         \
+      return 0;                                                                                         \
+    m= n / 2;                                                                                           \
+    self= v[m];                                                                                         \
+    self->field.avl_left= INT2_TREE_BUILD_##node##_##field(v, m);                                       \
+    self->field.avl_right= INT2_TREE_BUILD_##node##_##field(v + m + 1, n - m - 1);                      \
+    return INT2_UPDATE_##node##_##field(self);                                                          \
+  }                                                                                                     \
+                                                                                                        \
+ /* v is reordered.  loading into a non-empty tree falls back to one insertion per node */              \
+                                                                                                        \
+struct node *INT2_TREE_BULK_LOAD_##node##_##field                                                       \
+  (struct node *self, struct node **v, int n, int (*compare)(struct node *lhs, struct node *rhs))       \
+  {                                                                                                     \
+    struct node *t;                                                                                     \
+    int i;                                                                                              \
+                                                                                                        \
+    if (self) {                                                                                         \
+      for (i= 0; i < n; i++)                                                                            \
+        self= INT2_TREE_INSERT_##node##_##field(self, v[i], compare);                                   \
+      return self;                                                                                      \
+    }                                                                                                   \
+    for (i= n/2 - 1; i >= 0; i--)                                                                       \
+      INT2_SIFT_##node##_##field(v, i, n, compare);                                                     \
+    for (i= n - 1; i > 0; i--) {                                                                        \
+      t= v[0]; v[0]= v[i]; v[i]= t;                                                                     \
+      INT2_SIFT_##node##_##field(v, 0, i, compare);                                                     \
+    }                                                                                                   \
+    return INT2_TREE_BUILD_##node##_##field(v, n);                                                      \
+  }
+
+#define INT2_TREE_INSERT(head, node, field, elm)                                                        \
+  ((head)->th_root= INT2_TREE_INSERT_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
+
+#define INT2_TREE_REMOVE(head, node, field, elm)                                                        \
+  ((head)->th_root= INT2_TREE_REMOVE_##node##_##field((head)->th_root, (elm), (head)->th_cmp))
+
+#define INT2_TREE_BULK_LOAD(head, node, field, v, n)                                                    \
+  ((head)->th_root= INT2_TREE_BULK_LOAD_##node##_##field((head)->th_root, (v), (n), (head)->th_cmp))
+
+#define INT2_OVERLAP_APPLY(head, node, field, elm, function, data)                                      \
+  INT2_OVERLAP_APPLY_##node##_##field((head)->th_root, (elm), function, data)
 
 #endif /* __tree_h */
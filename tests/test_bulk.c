@@ -0,0 +1,210 @@
+/* test_bulk.c -- INT_TREE_REMOVE_IF, _RANGE, _OVERLAPS and INT_TREE_REMOVE_NODE
+ *
+ * every bulk removal is checked against a brute force scan: the removed list must hold exactly
+ * the matching nodes, in order and unlinked, and the tree left behind must hold the rest with
+ * correct parent links, heights, balance and max_high.  overlap removal is run with both few
+ * and many matches so that the one-at-a-time path and the rebuild are both taken.  removed
+ * nodes are inserted again each round, which relies on INT_TREE_INSERT resetting their links.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../itree.h"
+
+#define NODES		3000
+#define ROUNDS		600
+
+typedef struct node {
+  long long low, high, max_high;
+  int id;
+  TREE_ENTRY(node) linkage;
+} node;
+
+typedef TREE_HEAD(tree, node) tree;
+
+static int ties;
+
+/* with ties set, nodes with the same interval compare equal */
+
+int compare(node *lhs, node *rhs)
+{
+  if (lhs->low != rhs->low) return (lhs->low < rhs->low) ? -1 : 1;
+  if (lhs->high != rhs->high) return (lhs->high < rhs->high) ? -1 : 1;
+  return ties ? 0 : (lhs->id > rhs->id) - (lhs->id < rhs->id);
+}
+
+TREE_DEFINE(node, linkage);
+
+static node nodes[NODES];
+static int in[NODES], hit[NODES];
+static int failures;
+
+static void fail(const char *what, int id)
+{
+  if (failures++ < 10) printf("%s (node %d)\n", what, id);
+}
+
+static long long rnd(long long lo, long long hi)
+{
+  return lo + (long long)(((unsigned long long)rand() << 16 ^ rand()) % (unsigned long long)(hi - lo + 1));
+}
+
+static int check_node(node *self, node *parent, int *count)
+{
+  int lh, rh;
+  long long m;
+
+  if (!self) return 0;
+  ++*count;
+  if (self->linkage.parent != parent) fail("bad parent link", self->id);
+  if (!in[self->id]) fail("removed node still in the tree", self->id);
+  lh= check_node(self->linkage.avl_left, self, count);
+  rh= check_node(self->linkage.avl_right, self, count);
+  if (self->linkage.avl_height != 1 + (lh > rh ? lh : rh)) fail("bad height", self->id);
+  if (lh - rh > TREE_DELTA_MAX || rh - lh > TREE_DELTA_MAX) fail("unbalanced", self->id);
+  m= self->high;
+  if (self->linkage.avl_left && self->linkage.avl_left->max_high > m) m= self->linkage.avl_left->max_high;
+  if (self->linkage.avl_right && self->linkage.avl_right->max_high > m) m= self->linkage.avl_right->max_high;
+  if (self->max_high != m) fail("bad max_high", self->id);
+  return 1 + (lh > rh ? lh : rh);
+}
+
+static void check_tree(tree *t)
+{
+  int i, count= 0, size= 0;
+
+  check_node(t->th_root, 0, &size);
+  for (i= 0; i < NODES; i++) count += in[i];
+  if (size != count) fail("tree size does not match", size);
+}
+
+/* hit[] marks the nodes expected to go; the removed list must hold exactly those, in order */
+
+static int check_removed(node *removed)
+{
+  static int seen[NODES];
+  node *n, *prev= 0;
+  int i, k= 0;
+
+  memset(seen, 0, sizeof seen);
+  for (n= removed; n; prev= n, n= n->linkage.avl_right) {
+    if (prev && compare(prev, n) > 0) fail("removed list out of order", n->id);
+    if (n->linkage.avl_left || n->linkage.parent) fail("removed node still linked", n->id);
+    seen[n->id]++;
+    k++;
+  }
+  for (i= 0; i < NODES; i++) {
+    if (seen[i] != hit[i]) fail("removed set does not match brute force", i);
+    if (seen[i]) in[i]= 0;
+  }
+  return k;
+}
+
+static void reinsert(tree *t)
+{
+  int i;
+
+  for (i= 0; i < NODES; i++) {
+    if (!in[i]) {
+      INT_TREE_INSERT(t, node, linkage, &nodes[i]);
+      in[i]= 1;
+    }
+  }
+}
+
+static int pred(node *n, void *data)
+{
+  return n->id % *(int *)data == 0;
+}
+
+int main(void)
+{
+  tree t;
+  node q, lo, hi, *removed;
+  int i, m, k, round, limit, few= 0, many= 0;
+
+  TREE_INIT(&t, compare);
+  srand(6);
+  for (i= 0; i < NODES; i++) {
+    nodes[i].low= rnd(-100000, 100000);
+    nodes[i].high= nodes[i].low + rnd(0, (i % 10) ? 500 : 20000);
+    nodes[i].id= i;
+  }
+  reinsert(&t);
+  check_tree(&t);
+
+  for (round= 0; round < ROUNDS; round++) {
+
+    /* overlaps: narrow queries take the one-at-a-time path, wide ones the rebuild */
+
+    q.low= rnd(-110000, 100000);
+    q.high= q.low + ((round & 1) ? rnd(0, 2000) : rnd(50000, 200000));
+    for (i= 0, k= 0; i < NODES; i++) {
+      hit[i]= in[i] && nodes[i].low <= q.high && nodes[i].high >= q.low;
+      k += hit[i];
+    }
+    limit= INT_TREE_BULK_LIMIT_node_linkage(t.th_root);
+    if (k > limit) many++; else if (k > 0) few++;
+    INT_TREE_REMOVE_OVERLAPS(&t, node, linkage, &q, &removed);
+    check_removed(removed);
+    check_tree(&t);
+
+    /* key range, with bounds that need not be in the tree */
+
+    lo.low= rnd(-110000, 100000);
+    lo.high= rnd(-110000, 120000);
+    lo.id= rnd(0, NODES);
+    hi.low= lo.low + ((round & 2) ? rnd(0, 3000) : rnd(0, 150000));
+    hi.high= rnd(-110000, 120000);
+    hi.id= rnd(0, NODES);
+    for (i= 0; i < NODES; i++)
+      hit[i]= in[i] && compare(&nodes[i], &lo) >= 0 && compare(&nodes[i], &hi) <= 0;
+    INT_TREE_REMOVE_RANGE(&t, node, linkage, &lo, &hi, &removed);
+    check_removed(removed);
+    check_tree(&t);
+
+    /* predicate */
+
+    m= 2 + round % 7;
+    for (i= 0; i < NODES; i++)
+      hit[i]= in[i] && pred(&nodes[i], &m);
+    INT_TREE_REMOVE_IF(&t, node, linkage, pred, &m, &removed);
+    check_removed(removed);
+    check_tree(&t);
+
+    reinsert(&t);
+    check_tree(&t);
+  }
+  if (!few || !many) {
+    printf("overlap removal: %d one-at-a-time rounds, %d rebuilds\n", few, many);
+    failures++;
+  }
+
+  /* INT_TREE_REMOVE_NODE takes out the very node given, even among nodes that compare equal */
+
+  TREE_INIT(&t, compare);
+  memset(in, 0, sizeof in);
+  for (i= 0; i < NODES; i++) {
+    nodes[i].low= i % 5;
+    nodes[i].high= nodes[i].low + 1;
+  }
+  ties= 1;
+  reinsert(&t);
+  check_tree(&t);
+  for (round= 0; round < NODES; round++) {
+    i= (round * 7919) % NODES;
+    t.th_root= INT_TREE_REMOVE_NODE_node_linkage(t.th_root, &nodes[i]);
+    in[i]= 0;
+    if (nodes[i].linkage.avl_left || nodes[i].linkage.avl_right || nodes[i].linkage.parent)
+      fail("removed node still linked", i);
+    if (round % 25 == 0)
+      check_tree(&t);
+  }
+  check_tree(&t);
+  if (t.th_root) fail("tree not empty", t.th_root->id);
+
+  printf("bulk: %d failures\n%s\n", failures, failures ? "FAIL" : "ok");
+  return failures != 0;
+}
@@ -0,0 +1,159 @@
+/* test_dup.c -- duplicate lists over an interval tree
+ *
+ * records are drawn from a small set of intervals so that most of them are duplicates, then
+ * inserted and removed at random through INT_TREE_INSERT_DUP and INT_TREE_REMOVE_DUP.  after
+ * every step the tree must hold one structural node per distinct interval with the right
+ * dup_count and a consistent max_high, and INT_DUP_OVERLAP_APPLY must report every record.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../itree.h"
+
+#define RECORDS		600
+#define INTERVALS	40
+#define STEPS		20000
+
+typedef struct node {
+  long long low, high, max_high;
+  int id;
+  TREE_ENTRY(node) linkage;
+  TREE_DUP_ENTRY(node) dup;
+} node;
+
+typedef TREE_HEAD(tree, node) tree;
+
+int compare(node *lhs, node *rhs)
+{
+  if (lhs->low != rhs->low) return (lhs->low < rhs->low) ? -1 : 1;
+  return (lhs->high > rhs->high) - (lhs->high < rhs->high);
+}
+
+TREE_DEFINE(node, linkage);
+TREE_DEFINE_DUP(node, linkage, dup);
+
+static node records[RECORDS];
+static int in[RECORDS];
+static int failures;
+
+static void fail(const char *what, int id)
+{
+  if (failures++ < 10) printf("%s (record %d)\n", what, id);
+}
+
+static long long check_tree(node *self, node *parent, int *structural)
+{
+  long long m;
+
+  if (!self) return -1000000000;
+  if (self->linkage.parent != parent) fail("bad parent link", self->id);
+  if (!in[self->id]) fail("removed record still in the tree", self->id);
+  ++*structural;
+  m= self->high;
+  if (check_tree(self->linkage.avl_left, self, structural) > m) m= self->linkage.avl_left->max_high;
+  if (check_tree(self->linkage.avl_right, self, structural) > m) m= self->linkage.avl_right->max_high;
+  if (self->max_high != m) fail("bad max_high", self->id);
+  return self->max_high;
+}
+
+static void mark(node *n, void *data)
+{
+  ((int *)data)[n->id]++;
+}
+
+static void check(tree *t)
+{
+  static int seen[RECORDS];
+  node q, *s;
+  int i, j, count, distinct, structural= 0;
+
+  check_tree(t->th_root, 0, &structural);
+
+  for (i= 0, distinct= 0; i < RECORDS; i++) {
+    if (!in[i]) continue;
+    for (j= 0, count= 0; j < RECORDS; j++) {
+      if (in[j] && records[j].low == records[i].low && records[j].high == records[i].high) {
+        if (j < i) break;
+        count++;
+      }
+    }
+    if (j < RECORDS) continue;
+    distinct++;
+    s= INT_TREE_FIND_DUP(t, node, linkage, &records[i]);
+    if (!s) {
+      fail("interval not found", i);
+      continue;
+    }
+    if ((int)INT_DUP_COUNT(s, dup) != count) fail("bad dup_count", s->id);
+    memset(seen, 0, sizeof seen);
+    INT_DUP_APPLY_node_linkage(s, mark, seen);
+    for (j= 0; j < RECORDS; j++) {
+      if (seen[j] != (in[j] && records[j].low == records[i].low && records[j].high == records[i].high))
+        fail("duplicate list does not match", j);
+    }
+  }
+  if (structural != distinct) fail("structural nodes do not match distinct intervals", structural);
+
+  q.low= rand() % 120 - 60;
+  q.high= q.low + rand() % 30;
+  memset(seen, 0, sizeof seen);
+  INT_DUP_OVERLAP_APPLY(t, node, linkage, &q, mark, seen);
+  for (j= 0; j < RECORDS; j++) {
+    if (seen[j] != (in[j] && records[j].low <= q.high && records[j].high >= q.low))
+      fail("overlap apply missed or repeated a record", j);
+  }
+}
+
+int main(void)
+{
+  tree t;
+  node *s, *next;
+  int i, step;
+
+  TREE_INIT(&t, compare);
+  srand(4);
+  for (i= 0; i < RECORDS; i++) {
+    records[i].low= (i % INTERVALS) * 3 - 60;
+    records[i].high= records[i].low + (i % INTERVALS) % 7;
+    records[i].id= i;
+  }
+
+  for (i= 0; i < RECORDS; i++) {
+    INT_TREE_INSERT_DUP(&t, node, linkage, &records[i]);
+    in[i]= 1;
+  }
+  check(&t);
+
+  /* removing a structural node promotes the next record of its list into the tree */
+
+  s= INT_TREE_FIND_DUP(&t, node, linkage, &records[0]);
+  next= s->dup.dup_next;
+  INT_TREE_REMOVE_DUP(&t, node, linkage, s);
+  in[s->id]= 0;
+  if (INT_TREE_FIND_DUP(&t, node, linkage, &records[0]) != next) fail("next record not promoted", next->id);
+  check(&t);
+
+  for (step= 0; step < STEPS; step++) {
+    i= rand() % RECORDS;
+
+    /* favour the structural node so that promotion is exercised often */
+
+    if (in[i] && (rand() & 1)) {
+      s= INT_TREE_FIND_DUP(&t, node, linkage, &records[i]);
+      if (s) i= s->id;
+    }
+    if (in[i])
+      INT_TREE_REMOVE_DUP(&t, node, linkage, &records[i]);
+    else
+      INT_TREE_INSERT_DUP(&t, node, linkage, &records[i]);
+    in[i]= !in[i];
+    if (step % 20 == 0)
+      check(&t);
+  }
+  check(&t);
+
+  printf("dup: %d failures\n%s\n", failures, failures ? "FAIL" : "ok");
+  return failures != 0;
+}
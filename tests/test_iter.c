@@ -0,0 +1,147 @@
+/* test_iter.c -- parent links, augmentation and iterators under random updates
+ *
+ * random INT_TREE_INSERT and INT_TREE_REMOVE sequences; after each step every node must have
+ * the right parent, max_high and height and be AVL balanced.  the in-order iterators must visit
+ * every node in both directions, and paging through an overlap cursor with a small buffer must
+ * return exactly the intervals a brute force scan finds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../itree.h"
+
+#define NODES		1500
+#define STEPS		30000
+#define PAGE		3
+
+typedef struct node {
+  long long low, high, max_high;
+  int id;
+  TREE_ENTRY(node) linkage;
+} node;
+
+typedef TREE_HEAD(tree, node) tree;
+
+int compare(node *lhs, node *rhs)
+{
+  if (lhs->low != rhs->low) return (lhs->low < rhs->low) ? -1 : 1;
+  if (lhs->high != rhs->high) return (lhs->high < rhs->high) ? -1 : 1;
+  return (lhs->id > rhs->id) - (lhs->id < rhs->id);
+}
+
+TREE_DEFINE(node, linkage);
+
+static node nodes[NODES];
+static int in[NODES];
+static int failures;
+
+static void fail(const char *what, int id)
+{
+  if (failures++ < 10) printf("%s (node %d)\n", what, id);
+}
+
+static long long rnd(long long lo, long long hi)
+{
+  return lo + (long long)(((unsigned long long)rand() << 16 ^ rand()) % (unsigned long long)(hi - lo + 1));
+}
+
+/* returns the height of the subtree, checking every node in it */
+
+static int check_node(node *self, node *parent, int *count)
+{
+  int lh, rh;
+  long long m;
+
+  if (!self) return 0;
+  ++*count;
+  if (self->linkage.parent != parent) fail("bad parent link", self->id);
+  if (!in[self->id]) fail("removed node still in the tree", self->id);
+  lh= check_node(self->linkage.avl_left, self, count);
+  rh= check_node(self->linkage.avl_right, self, count);
+  if (self->linkage.avl_height != 1 + (lh > rh ? lh : rh)) fail("bad height", self->id);
+  if (lh - rh > TREE_DELTA_MAX || rh - lh > TREE_DELTA_MAX) fail("unbalanced", self->id);
+  m= self->high;
+  if (self->linkage.avl_left && self->linkage.avl_left->max_high > m) m= self->linkage.avl_left->max_high;
+  if (self->linkage.avl_right && self->linkage.avl_right->max_high > m) m= self->linkage.avl_right->max_high;
+  if (self->max_high != m) fail("bad max_high", self->id);
+  return 1 + (lh > rh ? lh : rh);
+}
+
+static void check(tree *t)
+{
+  static int seen[NODES];
+  node q, *n, *prev, *buf[PAGE], *cursor;
+  int i, got, count= 0, size= 0;
+
+  check_node(t->th_root, 0, &size);
+  for (i= 0; i < NODES; i++) count += in[i];
+  if (size != count) fail("tree size does not match", size);
+
+  for (n= INT_TREE_FIRST(t, node, linkage), prev= 0, i= 0; n; prev= n, n= INT_TREE_NEXT(node, linkage, n), i++) {
+    if (prev && compare(prev, n) >= 0) fail("forward iteration out of order", n->id);
+  }
+  if (i != count) fail("forward iteration missed nodes", i);
+  for (n= INT_TREE_LAST(t, node, linkage), prev= 0, i= 0; n; prev= n, n= INT_TREE_PREV(node, linkage, n), i++) {
+    if (prev && compare(prev, n) <= 0) fail("reverse iteration out of order", n->id);
+  }
+  if (i != count) fail("reverse iteration missed nodes", i);
+
+  q.low= rnd(-110000, 100000);
+  q.high= q.low + rnd(0, 10000);
+  memset(seen, 0, sizeof seen);
+  prev= 0;
+  for (cursor= INT_OVERLAP_FIRST(t, node, linkage, &q); cursor; ) {
+    got= INT_OVERLAP_PAGE(node, linkage, &cursor, &q, buf, PAGE);
+    if (got < 1 || got > PAGE || (cursor && got != PAGE)) fail("bad page size", got);
+    for (i= 0; i < got; i++) {
+      if (prev && compare(prev, buf[i]) >= 0) fail("overlap pages out of order", buf[i]->id);
+      seen[buf[i]->id]++;
+      prev= buf[i];
+    }
+  }
+  for (i= 0; i < NODES; i++) {
+    if (seen[i] != (in[i] && nodes[i].low <= q.high && nodes[i].high >= q.low))
+      fail("overlap pages do not match brute force", i);
+  }
+}
+
+int main(void)
+{
+  tree t;
+  int i, step;
+
+  TREE_INIT(&t, compare);
+  srand(5);
+  for (i= 0; i < NODES; i++) {
+    nodes[i].low= rnd(-100000, 100000);
+    nodes[i].high= nodes[i].low + rnd(0, (i % 10) ? 500 : 20000);
+    nodes[i].id= i;
+  }
+
+  for (step= 0; step < STEPS; step++) {
+    i= rand() % NODES;
+    if (in[i])
+      INT_TREE_REMOVE(&t, node, linkage, &nodes[i]);
+    else
+      INT_TREE_INSERT(&t, node, linkage, &nodes[i]);
+    in[i]= !in[i];
+    if (step < 2000 || step % 50 == 0)
+      check(&t);
+  }
+
+  /* empty the tree again */
+
+  for (i= 0; i < NODES; i++) {
+    if (in[i]) {
+      INT_TREE_REMOVE(&t, node, linkage, &nodes[i]);
+      in[i]= 0;
+    }
+  }
+  check(&t);
+  if (t.th_root) fail("tree not empty", t.th_root->id);
+
+  printf("iter: %d failures\n%s\n", failures, failures ? "FAIL" : "ok");
+  return failures != 0;
+}
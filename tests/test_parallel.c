@@ -0,0 +1,180 @@
+/* test_parallel.c -- INT_PARALLEL_QUERY against serial runs of the same queries
+ *
+ * builds a random tree, runs INT_PARALLEL_MAX_INTERSECT and INT_PARALLEL_MAX_CONTAINMENT
+ * over a batch of queries on several threads and checks every result slot against the
+ * serial query.  the serial queries are in turn checked against a brute force scan, and the
+ * _ALL_ variants are checked to report exactly the overlapping (or contained) intervals.
+ *
+ * build with -fsanitize=thread to check the reentrancy of the query functions.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../itree.h"
+
+#define NODES		20000
+#define QUERIES		100000
+#define THREADS		8
+#define CHECKED		2000
+
+typedef struct node {
+  long long low, high, max_high;
+  TREE_ENTRY(node) linkage;
+} node;
+
+typedef TREE_HEAD(tree, node) tree;
+
+int compare(node *lhs, node *rhs)
+{
+  if (lhs->low != rhs->low) return (lhs->low < rhs->low) ? -1 : 1;
+  if (lhs->high != rhs->high) return (lhs->high < rhs->high) ? -1 : 1;
+  return (lhs < rhs) ? -1 : (lhs > rhs);
+}
+
+TREE_DEFINE(node, linkage);
+TREE_DEFINE_PARALLEL(node, linkage);
+
+static node nodes[NODES];
+static node queries[QUERIES];
+static node *qp[QUERIES];
+static unsigned long long par[QUERIES], ser[QUERIES];
+
+static long long rnd(long long lo, long long hi)
+{
+  return lo + (long long)(((unsigned long long)rand() << 16 ^ rand()) % (unsigned long long)(hi - lo + 1));
+}
+
+static void random_interval(node *n, long long span)
+{
+  n->low= rnd(-1000000, 1000000);
+  n->high= n->low + rnd(0, span);
+}
+
+static unsigned long long brute(node *q, int containment)
+{
+  unsigned long long best= 0, len, a, b;
+  long long lo, hi;
+  int i;
+
+  for (i= 0; i < NODES; i++) {
+    if (containment) {
+      if (nodes[i].low < q->low || nodes[i].high > q->high) continue;
+      a= nodes[i].low - q->low;
+      b= q->high - nodes[i].high;
+      len= (a < b) ? a : b;
+    }
+    else {
+      if (nodes[i].low > q->high || nodes[i].high < q->low) continue;
+      lo= (nodes[i].low > q->low) ? nodes[i].low : q->low;
+      hi= (nodes[i].high < q->high) ? nodes[i].high : q->high;
+      len= hi - lo;
+    }
+    if (len > best) best= len;
+  }
+  return best;
+}
+
+static int brute_count(node *q, int containment)
+{
+  int i, count= 0;
+
+  for (i= 0; i < NODES; i++) {
+    if (containment ? (nodes[i].low >= q->low && nodes[i].high <= q->high)
+                    : (nodes[i].low <= q->high && nodes[i].high >= q->low))
+      count++;
+  }
+  return count;
+}
+
+static void count_hit(node *n, unsigned long long len, void *data)
+{
+  (void)n; (void)len;
+  ++*(int *)data;
+}
+
+static int check(tree *t, int containment, const char *name)
+{
+  int i, used, hits, failures= 0;
+
+  used= containment
+    ? INT_PARALLEL_MAX_CONTAINMENT(t, node, linkage, qp, par, QUERIES, THREADS)
+    : INT_PARALLEL_MAX_INTERSECT(t, node, linkage, qp, par, QUERIES, THREADS);
+  if (used < 1 || used > THREADS) {
+    printf("%s: %d threads used\n", name, used);
+    failures++;
+  }
+
+  for (i= 0; i < QUERIES; i++) {
+    ser[i]= containment
+      ? INT_MAX_CONTAINMENT_node_linkage(t->th_root, qp[i])
+      : INT_MAX_INTERSECT_node_linkage(t->th_root, qp[i]);
+    if (par[i] != ser[i]) {
+      if (failures++ < 10) printf("%s: query %d: parallel %llu serial %llu\n", name, i, par[i], ser[i]);
+    }
+  }
+
+  for (i= 0; i < CHECKED; i++) {
+    if (ser[i] != brute(qp[i], containment)) {
+      if (failures++ < 10) printf("%s: query %d: serial %llu brute %llu\n", name, i, ser[i], brute(qp[i], containment));
+    }
+    hits= 0;
+    if (containment)
+      INT_ALL_CONTAINMENT_node_linkage(t->th_root, qp[i], count_hit, &hits);
+    else
+      INT_ALL_INTERSECT_node_linkage(t->th_root, qp[i], count_hit, &hits);
+    if (hits != brute_count(qp[i], containment)) {
+      if (failures++ < 10) printf("%s: query %d: %d hits reported, %d expected\n", name, i, hits, brute_count(qp[i], containment));
+    }
+  }
+
+  printf("%s: %d queries on %d threads, %d failures\n", name, QUERIES, used, failures);
+  return failures;
+}
+
+int main(void)
+{
+  tree t;
+  node one;
+  unsigned long long r;
+  int i, failures= 0;
+
+  TREE_INIT(&t, compare);
+  srand(1);
+
+  for (i= 0; i < NODES; i++) {
+    random_interval(&nodes[i], 2000);
+    INT_TREE_INSERT(&t, node, linkage, &nodes[i]);
+  }
+  for (i= 0; i < QUERIES; i++) {
+    random_interval(&queries[i], (i & 1) ? 20000 : 200);
+    qp[i]= &queries[i];
+  }
+
+  failures += check(&t, 0, "intersect");
+  failures += check(&t, 1, "containment");
+
+  /* a batch smaller than one grain runs on the calling thread alone */
+
+  if (INT_PARALLEL_MAX_INTERSECT(&t, node, linkage, qp, par, INT_PARALLEL_GRAIN, THREADS) != 1) {
+    printf("small batch: more than one thread used\n");
+    failures++;
+  }
+
+  /* touching intervals overlap with length 0 but still count as hits */
+
+  TREE_INIT(&t, compare);
+  nodes[0].low= -10; nodes[0].high= 10;
+  INT_TREE_INSERT(&t, node, linkage, &nodes[0]);
+  one.low= 10; one.high= 20;
+  i= 0;
+  r= INT_ALL_INTERSECT_node_linkage(t.th_root, &one, count_hit, &i);
+  if (r != 0 || i != 1) {
+    printf("touching: %llu returned, %d hits\n", r, i);
+    failures++;
+  }
+
+  printf("%s\n", failures ? "FAIL" : "ok");
+  return failures != 0;
+}
@@ -0,0 +1,175 @@
+/* test_ptree.c -- clone and release accounting for persistent trees
+ *
+ * with no snapshot outstanding a persistent tree must behave like an ordinary one: no node is
+ * ever cloned and release() is called exactly on the nodes removed.  with snapshots, the old
+ * versions must keep their contents, and once every version is released each node (original or
+ * clone) must have been released exactly once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../itree.h"
+
+#define NODES		2000
+#define UPDATES		20000
+
+typedef struct node {
+  long long low, high, max_high;
+  int id, cloned;
+  PTREE_ENTRY(node) linkage;
+} node;
+
+typedef PTREE_HEAD(tree, node) tree;
+
+static node nodes[NODES];
+static int in[NODES], released[NODES];
+static int clones, clones_released, failures;
+
+int compare(node *lhs, node *rhs)
+{
+  if (lhs->low != rhs->low) return (lhs->low < rhs->low) ? -1 : 1;
+  if (lhs->high != rhs->high) return (lhs->high < rhs->high) ? -1 : 1;
+  return (lhs->id > rhs->id) - (lhs->id < rhs->id);
+}
+
+node *clone(node *self)
+{
+  node *copy= (node *)malloc(sizeof *copy);
+
+  *copy= *self;
+  copy->cloned= 1;
+  clones++;
+  return copy;
+}
+
+void release(node *self)
+{
+  if (self->cloned) {
+    clones_released++;
+    free(self);
+  }
+  else
+    released[self->id]++;
+}
+
+PTREE_DEFINE(node, linkage);
+
+static long long rnd(long long lo, long long hi)
+{
+  return lo + (long long)(((unsigned long long)rand() << 16 ^ rand()) % (unsigned long long)(hi - lo + 1));
+}
+
+static void mark(node *n, void *data)
+{
+  ((int *)data)[n->id]++;
+}
+
+/* the version rooted at root must hold exactly the ids set in expect */
+
+static void check_contents(node *root, int *expect, const char *what)
+{
+  static int seen[NODES];
+  node all;
+  int i;
+
+  memset(seen, 0, sizeof seen);
+  all.low= -1000000000; all.high= 1000000000;
+  PTREE_OVERLAP_APPLY(root, node, linkage, &all, mark, seen);
+  for (i= 0; i < NODES; i++) {
+    if (seen[i] != expect[i]) {
+      if (failures++ < 10) printf("%s: node %d seen %d times, expected %d\n", what, i, seen[i], expect[i]);
+    }
+  }
+}
+
+/* a node may not be inserted again while an older version still holds it */
+
+static void update(tree *t, int *held)
+{
+  int i= rand() % NODES;
+
+  if (in[i])
+    PTREE_REMOVE(t, node, linkage, &nodes[i]);
+  else if (!held[i])
+    PTREE_INSERT(t, node, linkage, &nodes[i]);
+  else
+    return;
+  in[i]= !in[i];
+  held[i]= 1;
+}
+
+int main(void)
+{
+  tree t= PTREE_INITIALIZER(compare, clone, release);
+  static int old[NODES], held[NODES];
+  node *snap;
+  int i, u;
+
+  srand(3);
+  for (i= 0; i < NODES; i++) {
+    nodes[i].low= rnd(-100000, 100000);
+    nodes[i].high= nodes[i].low + rnd(0, 1000);
+    nodes[i].id= i;
+  }
+
+  /* no snapshots: updates are in place, and release() sees only removed nodes */
+
+  for (u= 0; u < UPDATES; u++) {
+    i= rand() % NODES;
+    if (in[i]) {
+      PTREE_REMOVE(&t, node, linkage, &nodes[i]);
+      if (released[i] != 1) {
+        if (failures++ < 10) printf("removed node %d released %d times\n", i, released[i]);
+      }
+      released[i]= 0;
+    }
+    else
+      PTREE_INSERT(&t, node, linkage, &nodes[i]);
+    in[i]= !in[i];
+  }
+  for (i= 0; i < NODES; i++) {
+    if (released[i]) {
+      if (failures++ < 10) printf("node %d released while still in the tree\n", i);
+    }
+  }
+  if (clones) {
+    printf("%d clones made with no snapshot outstanding\n", clones);
+    failures++;
+  }
+  check_contents(t.th_root, in, "unshared");
+
+  /* with a snapshot: the old version keeps its contents while the new one moves on */
+
+  memcpy(old, in, sizeof old);
+  memcpy(held, in, sizeof held);
+  snap= PTREE_SNAPSHOT(&t, node, linkage);
+  for (u= 0; u < UPDATES / 10; u++)
+    update(&t, held);
+  if (!clones) {
+    printf("no clones made with a snapshot outstanding\n");
+    failures++;
+  }
+  check_contents(snap, old, "snapshot");
+  check_contents(t.th_root, in, "current");
+
+  /* releasing both versions releases every node and clone once */
+
+  PTREE_RELEASE(&t, node, linkage, snap);
+  check_contents(t.th_root, in, "after snapshot release");
+  PTREE_RELEASE(&t, node, linkage, t.th_root);
+  t.th_root= 0;
+  for (i= 0; i < NODES; i++) {
+    if (released[i] != held[i]) {
+      if (failures++ < 10) printf("node %d released %d times\n", i, released[i]);
+    }
+  }
+  if (clones_released != clones) {
+    printf("%d clones made, %d released\n", clones, clones_released);
+    failures++;
+  }
+
+  printf("ptree: %d clones, %d failures\n%s\n", clones, failures, failures ? "FAIL" : "ok");
+  return failures != 0;
+}
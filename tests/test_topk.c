@@ -0,0 +1,115 @@
+/* test_topk.c -- INT_TOPK__INTERSECT against a brute force ranking
+ *
+ * random trees over signed coordinates on both sides of zero; for each query the scores
+ * returned must be the k largest overlap lengths, best first, and each returned node must
+ * really overlap the query by its score.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../itree.h"
+
+#define NODES		3000
+#define QUERIES		3000
+#define K		8
+
+typedef struct node {
+  long long low, high, max_high;
+  TREE_ENTRY(node) linkage;
+} node;
+
+typedef TREE_HEAD(tree, node) tree;
+
+int compare(node *lhs, node *rhs)
+{
+  if (lhs->low != rhs->low) return (lhs->low < rhs->low) ? -1 : 1;
+  if (lhs->high != rhs->high) return (lhs->high < rhs->high) ? -1 : 1;
+  return (lhs < rhs) ? -1 : (lhs > rhs);
+}
+
+TREE_DEFINE(node, linkage);
+
+static node nodes[NODES];
+
+static long long rnd(long long lo, long long hi)
+{
+  return lo + (long long)(((unsigned long long)rand() << 16 ^ rand()) % (unsigned long long)(hi - lo + 1));
+}
+
+static unsigned long long overlap(node *a, node *b)
+{
+  long long lo, hi;
+
+  lo= (a->low > b->low) ? a->low : b->low;
+  hi= (a->high < b->high) ? a->high : b->high;
+  return hi - lo;
+}
+
+static int descending(const void *a, const void *b)
+{
+  unsigned long long x= *(const unsigned long long *)a, y= *(const unsigned long long *)b;
+  return (x < y) - (x > y);
+}
+
+static int check(tree *t, node *q, int n, int k)
+{
+  static unsigned long long expect[NODES];
+  node *found[K];
+  unsigned long long scores[K];
+  int i, m, count;
+
+  for (i= m= 0; i < n; i++) {
+    if (nodes[i].low <= q->high && nodes[i].high >= q->low)
+      expect[m++]= overlap(&nodes[i], q);
+  }
+  qsort(expect, m, sizeof expect[0], descending);
+  if (m > k) m= k;
+
+  count= INT_TOPK__INTERSECT(t, node, linkage, q, found, scores, k);
+  if (count != m) {
+    printf("[%lld,%lld]: %d found, %d expected\n", q->low, q->high, count, m);
+    return 1;
+  }
+  for (i= 0; i < count; i++) {
+    if (scores[i] != expect[i] || overlap(found[i], q) != scores[i]
+        || found[i]->low > q->high || found[i]->high < q->low) {
+      printf("[%lld,%lld]: rank %d scored %llu, %llu expected\n", q->low, q->high, i, scores[i], expect[i]);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(void)
+{
+  tree t;
+  node q;
+  int i, round, failures= 0;
+
+  /* a single interval across zero, queried from inside */
+
+  TREE_INIT(&t, compare);
+  nodes[0].low= -10; nodes[0].high= 10;
+  INT_TREE_INSERT(&t, node, linkage, &nodes[0]);
+  q.low= -5; q.high= 5;
+  failures += check(&t, &q, 1, K);
+
+  srand(2);
+  for (round= 0; round < 3; round++) {
+    TREE_INIT(&t, compare);
+    for (i= 0; i < NODES; i++) {
+      nodes[i].low= rnd(-50000, 50000) - round * 50000;
+      nodes[i].high= nodes[i].low + rnd(0, 3000);
+      INT_TREE_INSERT(&t, node, linkage, &nodes[i]);
+    }
+    for (i= 0; i < QUERIES; i++) {
+      q.low= rnd(-60000, 60000) - round * 50000;
+      q.high= q.low + rnd(0, (i & 1) ? 10000 : 500);
+      failures += check(&t, &q, NODES, 1 + i % K);
+    }
+  }
+
+  printf("topk: %d failures\n%s\n", failures, failures ? "FAIL" : "ok");
+  return failures != 0;
+}